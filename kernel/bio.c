@@ -1,17 +1,27 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
+// Each hash bucket has its own lock, so lookups of different
+// blocks rarely contend, and a lookup only walks one short chain
+// no matter how large NBUF is.  Instead of keeping an LRU list,
+// brelse() stamps each buffer with a logical clock when its last
+// reference goes away, and a miss recycles the unused buffer with
+// the oldest stamp.
+//
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+// * After changing buffer data, call bwrite to write it to disk,
+//     or bwritev to write several buffers as one batch.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To start reading blocks that will be needed soon,
+//     call breadahead; it does not wait for the disk.
 
 
 #include "types.h"
@@ -23,32 +33,115 @@
 #include "fs.h"
 #include "buf.h"
 
+#define NBUCKET ((NBUF/4) | 1)  // odd, about 4 buffers per chain
+
 struct {
+  // Serializes recycling, so that two misses can't
+  // claim the same buffer or insert the same block twice.
+  // Acquired before any bucket lock.
   struct spinlock lock;
   struct buf buf[NBUF];
+  uint64 clock;   // logical time for LRU stamps
+
+  // Hash chains of buffers, through next.
+  // bucket[i].lock protects the chain and the
+  // dev, blockno, refcnt and lastuse of its buffers.
+  struct {
+    struct spinlock lock;
+    struct buf *head;
+  } bucket[NBUCKET];
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  int nhit;
+  int nmiss;
+  int nasync;   // read-ahead bufs waiting for the disk
+  int nra;      // blocks read ahead
+  int nrahit;   // read-ahead blocks later asked for
+  int nrawaste; // read-ahead blocks recycled unused
 } bcache;
 
+static int
+bhash(uint dev, uint blockno)
+{
+  return ((dev << 24) ^ blockno) % NBUCKET;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  int i;
 
   initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  // Spread the buffers over the chains; they hold
+  // no block yet, so any chain will do.
+  for(i = 0, b = bcache.buf; b < bcache.buf+NBUF; b++, i++){
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->next = bcache.bucket[i % NBUCKET].head;
+    bcache.bucket[i % NBUCKET].head = b;
+  }
+}
+
+// Look for block on device dev in chain h.
+// Caller must hold bcache.bucket[h].lock.
+static struct buf*
+bfind(int h, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bcache.bucket[h].head; b; b = b->next){
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  }
+  return 0;
+}
+
+// Find the unused buffer with the oldest stamp, take it
+// off its chain, and return it with refcnt 1.
+// Caller must hold bcache.lock.
+static struct buf*
+brecycle(void)
+{
+  struct buf *b, *best, **pp;
+  int i, h;
+
+  for(;;){
+    // Scan one chain at a time, so hits in other
+    // chains can proceed meanwhile.
+    best = 0;
+    h = -1;
+    for(i = 0; i < NBUCKET; i++){
+      acquire(&bcache.bucket[i].lock);
+      for(b = bcache.bucket[i].head; b; b = b->next){
+        if(b->refcnt == 0 && (best == 0 || b->lastuse < best->lastuse)){
+          best = b;
+          h = i;
+        }
+      }
+      release(&bcache.bucket[i].lock);
+    }
+    if(best == 0)
+      panic("bget: no buffers");
+
+    // Only bget() under bcache.lock moves buffers between
+    // chains, so best is still in chain h, but a hit may
+    // have taken a reference since the scan.
+    acquire(&bcache.bucket[h].lock);
+    if(best->refcnt == 0){
+      for(pp = &bcache.bucket[h].head; *pp != best; pp = &(*pp)->next)
+        ;
+      *pp = best->next;
+      best->refcnt = 1;
+      if(best->ra){
+        best->ra = 0;
+        bcache.nrawaste++;
+      }
+      release(&bcache.bucket[h].lock);
+      return best;
+    }
+    release(&bcache.bucket[h].lock);
   }
 }
 
@@ -59,33 +152,112 @@ static struct buf*
 bget(uint dev, uint blockno)
 {
   struct buf *b;
+  int h;
 
-  acquire(&bcache.lock);
+  h = bhash(dev, blockno);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  acquire(&bcache.bucket[h].lock);
+  if((b = bfind(h, dev, blockno)) != 0){
+    b->refcnt++;
+    __sync_fetch_and_add(&bcache.nhit, 1);
+    if(b->ra){
+      b->ra = 0;
+      __sync_fetch_and_add(&bcache.nrahit, 1);
     }
+    release(&bcache.bucket[h].lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bcache.bucket[h].lock);
 
   // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  acquire(&bcache.lock);
+
+  // Another miss may have cached it while
+  // bcache.lock was not held.
+  acquire(&bcache.bucket[h].lock);
+  if((b = bfind(h, dev, blockno)) != 0){
+    b->refcnt++;
+    __sync_fetch_and_add(&bcache.nhit, 1);
+    if(b->ra){
+      b->ra = 0;
+      __sync_fetch_and_add(&bcache.nrahit, 1);
+    }
+    release(&bcache.bucket[h].lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bcache.bucket[h].lock);
+
+  // Recycle the least recently used unused buffer.
+  // It is on no chain, so no one else can see it
+  // while its identity changes.
+  b = brecycle();
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+
+  acquire(&bcache.bucket[h].lock);
+  b->next = bcache.bucket[h].head;
+  bcache.bucket[h].head = b;
+  __sync_fetch_and_add(&bcache.nmiss, 1);
+  release(&bcache.bucket[h].lock);
+
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Is the block in the cache, or on its way in?
+static int
+bcached(uint dev, uint blockno)
+{
+  int h, r;
+
+  h = bhash(dev, blockno);
+  acquire(&bcache.bucket[h].lock);
+  r = bfind(h, dev, blockno) != 0;
+  release(&bcache.bucket[h].lock);
+  return r;
+}
+
+// Start reading the n blocks in blocknos into the cache,
+// and return without waiting for the disk. Blocks that are
+// already cached are skipped, and so is everything once
+// NBUF/4 read-ahead bufs are waiting for the disk. Each buf
+// stays locked and referenced until its data arrives and
+// the driver calls bdone().
+void
+breadahead(uint dev, uint *blocknos, int n)
+{
+  struct buf *bs[RAMAX], *b;
+  int i, m;
+
+  if(n > RAMAX)
+    n = RAMAX;
+
+  m = 0;
+  for(i = 0; i < n; i++){
+    if(bcached(dev, blocknos[i]))
+      continue;
+    if(bcache.nasync >= NBUF/4)
+      break;
+    b = bget(dev, blocknos[i]);
+    if(b->valid){
+      // someone else read it in since bcached().
+      brelse(b);
+      continue;
     }
+    b->async = 1;
+    b->ra = 1;
+    __sync_fetch_and_add(&bcache.nasync, 1);
+    bs[m++] = b;
   }
-  panic("bget: no buffers");
+  __sync_fetch_and_add(&bcache.nra, m);
+  if(m > 0)
+    virtio_disk_start(bs, m, 0);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -102,6 +274,19 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Return a locked buf for the indicated block without
+// reading it from disk, for a caller that is about to
+// overwrite all of it, such as a log block.
+struct buf*
+bclaim(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  b->valid = 1;
+  return b;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,8 +296,40 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Write the contents of n locked bufs to disk as one batch,
+// so the driver can merge consecutive blocks into one request.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+  }
+  virtio_disk_start(bs, n, 1);
+  for(i = 0; i < n; i++)
+    virtio_disk_wait(bs[i]);
+}
+
+// Drop a reference to an unlocked buffer.
+// Stamp it with the time of its last use.
+static void
+bput(struct buf *b)
+{
+  int h;
+
+  h = bhash(b->dev, b->blockno);
+  acquire(&bcache.bucket[h].lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it.
+    b->lastuse = __sync_add_and_fetch(&bcache.clock, 1);
+  }
+  release(&bcache.bucket[h].lock);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
 void
 brelse(struct buf *b)
 {
@@ -120,34 +337,58 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bput(b);
+}
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+// Called by the disk driver, perhaps in an interrupt,
+// when a read started by breadahead() is done.
+// The process that started it has moved on, so
+// release the buffer on its behalf.
+void
+bdone(struct buf *b)
+{
+  b->async = 0;
+  b->valid = 1;
+  __sync_fetch_and_sub(&bcache.nasync, 1);
+  releasesleep(&b->lock);
+  bput(b);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[h].lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bcache.bucket[h].lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[h].lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bcache.bucket[h].lock);
 }
 
+// Report hits, misses and lock contention for /statistics.
+int
+bcachestats(char *buf, int sz)
+{
+  int i, n, acq, nts;
 
+  acq = nts = 0;
+  for(i = 0; i < NBUCKET; i++){
+    acq += bcache.bucket[i].lock.n;
+    nts += bcache.bucket[i].lock.nts;
+  }
+  n = snprintf(buf, sz, "bcache: %d buffers %d buckets\n", NBUF, NBUCKET);
+  n += snprintf(buf+n, sz-n, "bcache: hit %d miss %d\n", bcache.nhit, bcache.nmiss);
+  n += snprintf(buf+n, sz-n, "bcache: bucket #acquire %d #test-and-set %d\n", acq, nts);
+  n += snprintf(buf+n, sz-n, "bcache: recycle #acquire %d #test-and-set %d\n",
+                bcache.lock.n, bcache.lock.nts);
+  n += snprintf(buf+n, sz-n, "bcache: read-ahead %d hit %d wasted %d\n",
+                bcache.nra, bcache.nrahit, bcache.nrawaste);
+  return n;
+}
@@ -1,12 +1,14 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int async;   // release with bdone() when the disk is done?
+  int ra;      // read ahead, and not yet asked for?
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint64 lastuse;   // bcache.clock when refcnt last dropped to 0
+  struct buf *next; // hash bucket chain
   uchar data[BSIZE];
 };
 
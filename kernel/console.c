@@ -26,19 +26,25 @@
 #define C(x)  ((x)-'@')  // Control-x
 char intr_symbol[] = {'\n', '\t', C('D'), '\x7f', C('H'), C('P'), C('N'), 0};
 
+extern volatile int panicking; // from printf.c
+
 //
 // send one character to the uart.
 // called by printf, and to echo input characters,
 // but not from write().
+// it goes through the uart's output buffer, after any
+// earlier output, except for panic messages.
 //
 void
 consputc(int c)
 {
+  void (*putc)(int) = panicking ? uartputc_sync : uartputc;
+
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
+    putc('\b'); putc(' '); putc('\b');
   } else {
-    uartputc_sync(c);
+    putc(c);
   }
 }
 
@@ -59,13 +65,16 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
-
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  char buf[128];
+  int i, m;
+
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    uartwrite(buf, m);
   }
 
   return i;
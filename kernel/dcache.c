@@ -0,0 +1,168 @@
+// Directory name cache.
+//
+// Remembers the result of looking up a name in a directory,
+// (dev, directory inum, name) -> inum, so that namex() can
+// walk a path without reading directory blocks. An inum of 0
+// is a negative entry: the name is known not to exist, which
+// saves a full search for the misses of e.g. the shell's
+// command lookup.
+//
+// The cache is set-associative: a name hashes to one set of
+// NDCWAY entries with its own lock, and a miss replaces the
+// entry of the set that was used least recently.
+//
+// The file system keeps the cache coherent: entries for a
+// directory are only added or changed while holding that
+// directory's inode lock, by dirlink() and dirunlink() when
+// the directory changes, and by namex() after a dirlookup().
+// iput() purges a directory's entries when it is freed, so a
+// later inode with the same number cannot see them.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NDCWAY 4
+#define NDCSET (NDCACHE / NDCWAY)
+
+struct dentry {
+  uint dev;           // 0 if the entry is unused
+  uint dir;           // inum of the directory
+  uint inum;          // inum of name, 0 if name is absent
+  char name[DIRSIZ];
+  uint64 lastuse;
+};
+
+struct {
+  struct {
+    struct spinlock lock;
+    struct dentry e[NDCWAY];
+  } set[NDCSET];
+  uint64 clock;
+  int nhit;     // lookups answered by a positive entry
+  int nneg;     // lookups answered by a negative entry
+  int nmiss;
+} dcache;
+
+void
+dcacheinit(void)
+{
+  int i;
+
+  for(i = 0; i < NDCSET; i++)
+    initlock(&dcache.set[i].lock, "dcache");
+}
+
+static int
+dchash(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = (dev << 24) ^ dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h % NDCSET;
+}
+
+// Find the entry for name in set s.
+// Caller must hold dcache.set[s].lock.
+static struct dentry*
+dcfind(int s, uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.set[s].e; d < dcache.set[s].e+NDCWAY; d++){
+    if(d->dev == dev && d->dir == dir && strncmp(d->name, name, DIRSIZ) == 0)
+      return d;
+  }
+  return 0;
+}
+
+// Look name up in directory dir.
+// Returns 1 and sets *inum (0 if name does not
+// exist) if the answer is cached, 0 otherwise.
+int
+dclookup(uint dev, uint dir, char *name, uint *inum)
+{
+  struct dentry *d;
+  int s;
+
+  s = dchash(dev, dir, name);
+  acquire(&dcache.set[s].lock);
+  if((d = dcfind(s, dev, dir, name)) == 0){
+    release(&dcache.set[s].lock);
+    __sync_fetch_and_add(&dcache.nmiss, 1);
+    return 0;
+  }
+  d->lastuse = __sync_add_and_fetch(&dcache.clock, 1);
+  *inum = d->inum;
+  release(&dcache.set[s].lock);
+  if(*inum)
+    __sync_fetch_and_add(&dcache.nhit, 1);
+  else
+    __sync_fetch_and_add(&dcache.nneg, 1);
+  return 1;
+}
+
+// Record that name in directory dir is inum,
+// or that it does not exist if inum is 0.
+// Caller must hold the directory's inode lock.
+void
+dcenter(uint dev, uint dir, char *name, uint inum)
+{
+  struct dentry *d, *e;
+  int s;
+
+  s = dchash(dev, dir, name);
+  acquire(&dcache.set[s].lock);
+  if((d = dcfind(s, dev, dir, name)) == 0){
+    d = dcache.set[s].e;
+    for(e = d; e < dcache.set[s].e+NDCWAY; e++){
+      if(e->dev == 0){
+        d = e;
+        break;
+      }
+      if(e->lastuse < d->lastuse)
+        d = e;
+    }
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+  }
+  d->inum = inum;
+  d->lastuse = __sync_add_and_fetch(&dcache.clock, 1);
+  release(&dcache.set[s].lock);
+}
+
+// Forget every entry of directory dir, which is being freed.
+void
+dcpurge(uint dev, uint dir)
+{
+  struct dentry *d;
+  int s;
+
+  for(s = 0; s < NDCSET; s++){
+    acquire(&dcache.set[s].lock);
+    for(d = dcache.set[s].e; d < dcache.set[s].e+NDCWAY; d++){
+      if(d->dev == dev && d->dir == dir)
+        d->dev = 0;
+    }
+    release(&dcache.set[s].lock);
+  }
+}
+
+int
+dcachestats(char *buf, int sz)
+{
+  int n;
+
+  n = snprintf(buf, sz, "dcache: %d entries %d-way\n", NDCACHE, NDCWAY);
+  n += snprintf(buf+n, sz-n, "dcache: hit %d negative hit %d miss %d\n",
+                dcache.nhit, dcache.nneg, dcache.nmiss);
+  return n;
+}
@@ -1,5 +1,6 @@
 struct buf;
 struct context;
+struct dirent;
 struct file;
 struct inode;
 struct pipe;
@@ -12,10 +13,22 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bclaim(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+void            breadahead(uint, uint*, int);
+void            bdone(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bcachestats(char*, int);
+
+// dcache.c
+void            dcacheinit(void);
+int             dclookup(uint, uint, char*, uint*);
+void            dcenter(uint, uint, char*, uint);
+void            dcpurge(uint, uint);
+int             dcachestats(char*, int);
 
 // console.c
 void            consoleinit(void);
@@ -31,13 +44,19 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
+int             filegetdents(struct file*, uint64, int n, int flags);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filesplice(struct file*, struct file*, int n);
+int             filereadat(struct file*, char*, uint, int);
+int             filewriteback(struct file*, char*, uint, int);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+int             dirread(struct inode*, uint*, struct dirent*, struct inode**, int);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
@@ -63,18 +82,36 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kdup(void *);
+int             krefcnt(void *);
+int             kallocstats(char*, int);
+
+// mmap.c
+uint64          mmap(uint64, int, int, struct file*, uint);
+int             munmap(struct proc*, uint64, uint64);
+int             mmapfault(struct proc*, uint64, int);
+void            mmapprefault(struct proc*, uint64, uint64);
+void            mmapclear(struct proc*);
+int             mmapfork(struct proc*, struct proc*);
+uint64          mmapfloor(struct proc*);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+int             logstats(char*, int);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
 int             pipewrite(struct pipe*, uint64, int);
+int             pipesize(struct pipe*, int);
+int             pipewbegin(struct pipe*, char**, uint*);
+void            pipewend(struct pipe*, uint);
+int             piperbegin(struct pipe*, char**, uint*, int);
+void            piperend(struct pipe*, uint);
 
 // printf.c
 void            printf(char*, ...);
@@ -100,7 +137,12 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeupone(void*);
+int             sleepqstats(char*, int);
+int             schedstats(char*, int);
 void            yield(void);
+void            timeslice(void);
+int             setpriority(int, int);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -122,6 +164,10 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// start.c
+int             timerfired(void);
+void            cpukick(int);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -132,6 +178,12 @@ int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 char*           strchr(const char*, char c);
 
+// sprintf.c
+int             snprintf(char*, int, char*, ...);
+
+// stats.c
+void            statsinit(void);
+
 // syscall.c
 int             argint(int, int*);
 int             argstr(int, char*, int);
@@ -140,6 +192,16 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// timer.c
+void            timerqinit(void);
+uint64          mtime(void);
+uint            uptime(void);
+void            timerbusy(void);
+void            timeridle(void);
+int             timerintr(void);
+int             timersleep(uint64);
+int             timerstats(char*, int);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -150,6 +212,7 @@ void            usertrapret(void);
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
+void            uartwrite(char*, int);
 void            uartputc(int);
 void            uartputc_sync(int);
 int             uartgetc(void);
@@ -164,9 +227,12 @@ void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmlazy(pagetable_t, uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t*          walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -181,7 +247,10 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_start(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
 void            virtio_disk_intr(void);
+int             virtio_disk_stats(char*, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -129,6 +129,86 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// Read up to n bytes at offset off of f's inode into kernel
+// memory at dst, for mmap(). Returns the number read.
+int
+filereadat(struct file *f, char *dst, uint off, int n)
+{
+  int r;
+
+  ilock(f->ip);
+  r = readi(f->ip, 0, (uint64)dst, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+#define NGETDENTS 16  // entries read per pass
+
+// Read the entries of directory f, skipping empty ones, into
+// the n bytes at user address addr: struct dirents, or, with
+// GD_STAT, struct dirstats. Only whole entries are returned.
+// Returns the number of bytes written, 0 at the end of the
+// directory, or -1 if f is not a directory.
+int
+filegetdents(struct file *f, uint64 addr, int n, int flags)
+{
+  struct proc *p = myproc();
+  struct dirent des[NGETDENTS];
+  struct inode *ips[NGETDENTS];
+  struct dirstat ds;
+  int i, m, sz, tot, err;
+  uint off;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+
+  sz = (flags & GD_STAT) ? sizeof(ds) : sizeof(struct dirent);
+  for(tot = 0; n - tot >= sz; tot += m * sz){
+    m = (n - tot) / sz;
+    if(m > NGETDENTS)
+      m = NGETDENTS;
+
+    ilock(f->ip);
+    if(f->ip->type != T_DIR){
+      iunlock(f->ip);
+      return -1;
+    }
+    off = f->off;
+    m = dirread(f->ip, &off, des, (flags & GD_STAT) ? ips : 0, m);
+    f->off = off;
+    iunlock(f->ip);
+    if(m == 0)
+      break;
+
+    if((flags & GD_STAT) == 0){
+      if(copyout(p->pagetable, addr + tot, (char *)des, m * sz) < 0)
+        return -1;
+      continue;
+    }
+
+    // stat the entries without holding the directory's lock,
+    // since ".." must not be locked while its child is.
+    err = 0;
+    for(i = 0; i < m; i++){
+      ds.inum = des[i].inum;
+      memmove(ds.name, des[i].name, DIRSIZ);
+      ilock(ips[i]);
+      stati(ips[i], &ds.st);
+      iunlock(ips[i]);
+      if(!err && copyout(p->pagetable, addr + tot + i * sz, (char *)&ds, sz) < 0)
+        err = 1;
+    }
+    // an entry unlinked meanwhile is freed by the last iput().
+    begin_op();
+    for(i = 0; i < m; i++)
+      iput(ips[i]);
+    end_op();
+    if(err)
+      return -1;
+  }
+  return tot;
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
@@ -180,3 +260,107 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Move up to n bytes from file in to file out, where one is
+// a pipe and the other an inode, without a copy through
+// user space: readi() fills the pipe's buffer, or writei()
+// empties it. Like read(), splicing from a pipe waits only
+// until some data is available. Splicing into a pipe
+// stops at the end of the file.
+// Returns the number of bytes moved, or -1.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  // the same limit per transaction as filewrite().
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  struct pipe *pi;
+  struct inode *ip;
+  char *p;
+  uint m;
+  int r, tot;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+
+  tot = 0;
+  if(in->type == FD_INODE && out->type == FD_PIPE){
+    pi = out->pipe;
+    ip = in->ip;
+    while(tot < n){
+      if(pipewbegin(pi, &p, &m) < 0)
+        return tot > 0 ? tot : -1;
+      if(m > n - tot)
+        m = n - tot;
+      ilock(ip);
+      r = readi(ip, 0, (uint64)p, in->off, m);
+      if(r > 0)
+        in->off += r;
+      iunlock(ip);
+      pipewend(pi, r > 0 ? r : 0);
+      if(r <= 0)
+        break;
+      tot += r;
+    }
+  } else if(in->type == FD_PIPE && out->type == FD_INODE){
+    pi = in->pipe;
+    ip = out->ip;
+    while(tot < n){
+      if((r = piperbegin(pi, &p, &m, tot == 0)) <= 0){
+        if(r < 0 && tot == 0)
+          return -1;
+        break;
+      }
+      if(m > n - tot)
+        m = n - tot;
+      if(m > max)
+        m = max;
+      begin_op();
+      ilock(ip);
+      r = writei(ip, 0, (uint64)p, out->off, m);
+      if(r > 0)
+        out->off += r;
+      iunlock(ip);
+      end_op();
+      piperend(pi, r > 0 ? r : 0);
+      if(r != m)
+        return -1;
+      tot += r;
+    }
+  } else {
+    return -1;
+  }
+  return tot;
+}
+
+// Write n bytes from kernel memory at src to offset off of
+// f's inode, for munmap() of a MAP_SHARED mapping. Like a
+// store to a mapping, it doesn't extend the file: bytes at
+// or past its end are dropped.
+// Returns 0, or -1 on error.
+int
+filewriteback(struct file *f, char *src, uint off, int n)
+{
+  // the same limit per transaction as filewrite().
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int i, n1, r;
+
+  for(i = 0; i < n; i += n1){
+    n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+    begin_op();
+    ilock(f->ip);
+    if(off + i >= f->ip->size){
+      iunlock(f->ip);
+      end_op();
+      break;
+    }
+    if(n1 > f->ip->size - (off + i))
+      n1 = f->ip->size - (off + i);
+    r = writei(f->ip, 0, (uint64)src + i, off + i, n1);
+    iunlock(f->ip);
+    end_op();
+    if(r != n1)
+      return -1;
+  }
+  return 0;
+}
@@ -13,6 +13,26 @@ struct file {
 #define minor(dev)  ((dev) & 0xFFFF)
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
 
+// one slot of a directory's hash index.
+struct dixslot {
+  uint hash;  // hash of the entry's name; 0 if the slot was never used
+  uint off;   // 1 + offset of the dirent; DIX_DEAD once it is unlinked
+};
+#define DIX_DEAD 0xffffffff
+#define DIX_MAXPG 8   // max pages of slots per directory
+
+// in-memory hash index of a directory's entries, built
+// by dirlookup() the first time it searches the directory.
+// npg == 0 means the directory has no index.
+struct dirindex {
+  int npg;            // pages of slots
+  int nused;          // slots in use, including dead ones
+  int nlive;          // entries in the index
+  int toobig;         // too many entries to index
+  uint freeoff;       // no empty dirent below this offset
+  struct dixslot *pg[DIX_MAXPG];
+};
+
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
@@ -26,7 +46,13 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+
+  uint ra_off;        // offset where the last readi() ended
+  int ra_win;         // read-ahead window, in blocks
+  uint ra_next;       // first block not yet read ahead
+
+  struct dirindex dix; // T_DIR only; see dirlookup()
 };
 
 // map major device number to device functions.
@@ -38,3 +64,4 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define STATS   2
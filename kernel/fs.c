@@ -132,7 +132,9 @@ bfree(int dev, uint b)
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a table entry and increments its ref; iput()
-//   decrements ref.
+//   decrements ref. An entry whose ref is zero keeps its
+//   contents and directory index, and iget() reuses it for
+//   the same inode until it recycles the entry for another.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
@@ -188,6 +190,7 @@ iinit()
 }
 
 static struct inode* iget(uint dev, uint inum);
+static void dixfree(struct inode*);
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -246,10 +249,10 @@ iget(uint dev, uint inum)
 
   acquire(&itable.lock);
 
-  // Is the inode already in the table?
+  // Is the inode already in the table, perhaps unreferenced?
   empty = 0;
   for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&itable.lock);
       return ip;
@@ -263,10 +266,14 @@ iget(uint dev, uint inum)
     panic("iget: no inodes");
 
   ip = empty;
+  dixfree(ip);    // ref == 0: no one can hold ip->lock.
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->ra_off = 0;
+  ip->ra_win = 0;
+  ip->ra_next = 0;
   release(&itable.lock);
 
   return ip;
@@ -343,6 +350,8 @@ iput(struct inode *ip)
 
     release(&itable.lock);
 
+    if(ip->type == T_DIR)
+      dcpurge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
@@ -370,18 +379,39 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The last NDINDIRECT
+// blocks are listed in the NINDIRECT blocks listed in block
+// ip->addrs[NDIRECT+1].
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// Return entry i of the indirect block at addr.
+// If it is empty and alloc!=0, allocate a block for it;
+// otherwise return 0.
 static uint
-bmap(struct inode *ip, uint bn)
+bmapind(struct inode *ip, uint addr, uint i, int alloc)
 {
-  uint addr, *a;
+  uint *a;
   struct buf *bp;
 
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0 && alloc){
+    a[i] = addr = balloc(ip->dev);
+    log_write(bp);
+  }
+  brelse(bp);
+  return addr;
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block and alloc!=0, bmap allocates one;
+// otherwise it returns 0.
+static uint
+bmap(struct inode *ip, uint bn, int alloc)
+{
+  uint addr;
+
   if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
+    if((addr = ip->addrs[bn]) == 0 && alloc)
       ip->addrs[bn] = addr = balloc(ip->dev);
     return addr;
   }
@@ -389,16 +419,26 @@ bmap(struct inode *ip, uint bn)
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
+    if((addr = ip->addrs[NDIRECT]) == 0){
+      if(!alloc)
+        return 0;
       ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
     }
-    brelse(bp);
-    return addr;
+    return bmapind(ip, addr, bn, alloc);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load doubly-indirect block, then the indirect
+    // block it lists, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0){
+      if(!alloc)
+        return 0;
+      ip->addrs[NDIRECT+1] = addr = balloc(ip->dev);
+    }
+    if((addr = bmapind(ip, addr, bn / NINDIRECT, alloc)) == 0)
+      return 0;
+    return bmapind(ip, addr, bn % NINDIRECT, alloc);
   }
 
   panic("bmap: out of range");
@@ -409,10 +449,11 @@ bmap(struct inode *ip, uint bn)
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i, j, k;
+  struct buf *bp, *bp2;
+  uint *a, *a2;
 
+  dixfree(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -432,6 +473,26 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
+    a = (uint*)bp->data;
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j] == 0)
+        continue;
+      bp2 = bread(ip->dev, a[j]);
+      a2 = (uint*)bp2->data;
+      for(k = 0; k < NINDIRECT; k++){
+        if(a2[k])
+          bfree(ip->dev, a2[k]);
+      }
+      brelse(bp2);
+      bfree(ip->dev, a[j]);
+    }
+    brelse(bp);
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
   ip->size = 0;
   iupdate(ip);
 }
@@ -448,6 +509,40 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Called by readi() before it reads n bytes at off.
+// If the read continues where the last one ended, grow
+// ip's read-ahead window (doubling, up to RAMAX blocks)
+// and start reading the blocks after off/BSIZE that the
+// window covers, so they arrive while readi() copies out
+// the current one. Any other read closes the window.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint off, uint n)
+{
+  uint bn, end, addr, blocknos[RAMAX];
+  int k;
+
+  if(off != ip->ra_off || n == 0){
+    ip->ra_win = 0;
+    ip->ra_next = 0;
+    return;
+  }
+  ip->ra_win = ip->ra_win ? min(2*ip->ra_win, RAMAX) : 1;
+
+  end = min((off + n - 1)/BSIZE + 1 + ip->ra_win, (ip->size + BSIZE - 1)/BSIZE);
+  bn = off/BSIZE + 1;
+  if(bn < ip->ra_next)
+    bn = ip->ra_next;  // already started.
+  for(k = 0; bn < end && k < RAMAX; bn++){
+    if((addr = bmap(ip, bn, 0)) == 0)
+      break;
+    blocknos[k++] = addr;
+  }
+  ip->ra_next = bn;
+  if(k > 0)
+    breadahead(ip->dev, blocknos, k);
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -463,8 +558,9 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  readahead(ip, off, n);
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, bmap(ip, off/BSIZE, 1));
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
@@ -473,6 +569,7 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     }
     brelse(bp);
   }
+  ip->ra_off = off;
   return tot;
 }
 
@@ -495,7 +592,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, bmap(ip, off/BSIZE, 1));
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
@@ -524,8 +621,177 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Directory index.
+//
+// dirlookup() builds a hash table for a directory the first
+// time it searches it, mapping each name to the offset of its
+// dirent, so later lookups read one directory block instead of
+// scanning the whole directory. The slots live in pages from
+// kalloc(); the table is open-addressed with linear probing,
+// kept at most 3/4 full, and doubled (by rebuilding it) when it
+// fills, or freed when most of its entries are unlinked.
+// dirlink() and dirunlink() keep it up to date. The index is
+// protected by dp->lock and lasts as long as dp's inode table
+// entry: it is freed by itrunc() or when iget() recycles the
+// entry, not when the last reference goes away, so lookups in
+// directories that aren't open don't rebuild it. Directories
+// too big for DIX_MAXPG pages of slots are searched linearly.
+
+#define DIX_PERPG (PGSIZE / sizeof(struct dixslot))
+
+static uint
+dixhash(char *name)
+{
+  uint h = 5381;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 33 + (uchar)name[i];
+  return h ? h : 1;
+}
+
+static struct dixslot*
+dixslot(struct inode *dp, uint i)
+{
+  return &dp->dix.pg[i / DIX_PERPG][i % DIX_PERPG];
+}
+
+// Free dp's index, if any.
+static void
+dixfree(struct inode *dp)
+{
+  int i;
+
+  for(i = 0; i < dp->dix.npg; i++)
+    kfree(dp->dix.pg[i]);
+  dp->dix.npg = 0;
+  dp->dix.nused = 0;
+  dp->dix.nlive = 0;
+  dp->dix.toobig = 0;
+}
+
+// Add the entry for name at offset off to dp's index.
+// The caller has checked that there is room.
+static void
+dixput(struct inode *dp, char *name, uint off)
+{
+  uint n, h, i;
+  struct dixslot *s;
+
+  n = dp->dix.npg * DIX_PERPG;
+  h = dixhash(name);
+  for(i = h % n; ; i = (i + 1) % n){
+    s = dixslot(dp, i);
+    if(s->hash == 0 || s->off == DIX_DEAD)
+      break;
+  }
+  if(s->hash == 0)
+    dp->dix.nused++;
+  dp->dix.nlive++;
+  s->hash = h;
+  s->off = off + 1;
+}
+
+// Build an index of dp with room for at least need entries.
+// Returns 0 on success, -1 if dp is too big or out of memory.
+// Caller must hold dp->lock.
+static int
+dixbuild(struct inode *dp, uint need)
+{
+  uint off, npg;
+  struct dirent de;
+  int i;
+
+  dixfree(dp);
+
+  // Count live entries and find the first empty one.
+  dp->dix.freeoff = dp->size;
+  for(off = 0; off < dp->size; off += sizeof(de)){
+    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("dixbuild read");
+    if(de.inum)
+      need++;
+    else if(off < dp->dix.freeoff)
+      dp->dix.freeoff = off;
+  }
+
+  for(npg = 1; npg * DIX_PERPG * 3 / 4 < need; npg *= 2)
+    ;
+  if(npg > DIX_MAXPG){
+    dp->dix.toobig = 1;
+    return -1;
+  }
+  for(i = 0; i < npg; i++){
+    if((dp->dix.pg[i] = kalloc()) == 0){
+      dixfree(dp);
+      return -1;
+    }
+    memset(dp->dix.pg[i], 0, PGSIZE);
+    dp->dix.npg++;
+  }
+
+  for(off = 0; off < dp->size; off += sizeof(de)){
+    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("dixbuild read");
+    if(de.inum)
+      dixput(dp, de.name, off);
+  }
+  return 0;
+}
+
+// Look name up in dp's index, reading only the
+// dirents whose name hash matches.
+// Returns the inode number and sets *poff, or
+// returns 0 if name is not in dp.
+static uint
+dixlookup(struct inode *dp, char *name, uint *poff)
+{
+  uint n, h, i;
+  struct dixslot *s;
+  struct dirent de;
+
+  n = dp->dix.npg * DIX_PERPG;
+  h = dixhash(name);
+  for(i = h % n; (s = dixslot(dp, i))->hash != 0; i = (i + 1) % n){
+    if(s->hash != h || s->off == DIX_DEAD)
+      continue;
+    if(readi(dp, 0, (uint64)&de, s->off - 1, sizeof(de)) != sizeof(de))
+      panic("dixlookup read");
+    if(de.inum && namecmp(name, de.name) == 0){
+      *poff = s->off - 1;
+      return de.inum;
+    }
+  }
+  return 0;
+}
+
+// Forget the entry at offset off of dp's index.
+static void
+dixdel(struct inode *dp, char *name, uint off)
+{
+  uint n, i;
+  struct dixslot *s;
+
+  n = dp->dix.npg * DIX_PERPG;
+  for(i = dixhash(name) % n; (s = dixslot(dp, i))->hash != 0; i = (i + 1) % n){
+    if(s->off == off + 1){
+      s->off = DIX_DEAD;
+      dp->dix.nlive--;
+      break;
+    }
+  }
+  if(off < dp->dix.freeoff)
+    dp->dix.freeoff = off;
+
+  // Mostly empty: free it, and let the next
+  // dirlookup() build a smaller one.
+  if(dp->dix.npg > 1 && dp->dix.nlive * 8 < dp->dix.npg * DIX_PERPG)
+    dixfree(dp);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Caller must hold dp->lock.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
@@ -535,6 +801,16 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dp->dix.npg == 0 && !dp->dix.toobig)
+    dixbuild(dp, 0);
+  if(dp->dix.npg > 0){
+    if((inum = dixlookup(dp, name, &off)) == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -552,6 +828,30 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   return 0;
 }
 
+// Read up to n in-use entries of directory dp into des,
+// starting at offset *poff and moving *poff past them.
+// If ips is not 0, also return a reference to each entry's
+// inode in ips, so that it stays allocated after dp->lock
+// is released, until the caller iput()s it.
+// Returns the number of entries read.
+// Caller must hold dp->lock.
+int
+dirread(struct inode *dp, uint *poff, struct dirent *des, struct inode **ips, int n)
+{
+  int i;
+
+  for(i = 0; i < n && *poff < dp->size; *poff += sizeof(struct dirent)){
+    if(readi(dp, 0, (uint64)&des[i], *poff, sizeof(struct dirent)) != sizeof(struct dirent))
+      panic("dirread");
+    if(des[i].inum == 0)
+      continue;
+    if(ips)
+      ips[i] = iget(dp->dev, des[i].inum);
+    i++;
+  }
+  return i;
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
@@ -567,7 +867,8 @@ dirlink(struct inode *dp, char *name, uint inum)
   }
 
   // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
+  off = dp->dix.npg > 0 ? dp->dix.freeoff : 0;
+  for(; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlink read");
     if(de.inum == 0)
@@ -578,10 +879,35 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcenter(dp->dev, dp->inum, name, inum);
+
+  if(dp->dix.npg > 0){
+    dp->dix.freeoff = off + sizeof(de);
+    if((dp->dix.nused + 1) * 4 > dp->dix.npg * DIX_PERPG * 3)
+      dixbuild(dp, 0);  // grow; the new entry is on disk already.
+    else
+      dixput(dp, name, off);
+  }
 
   return 0;
 }
 
+// Remove the entry for name at offset off, as found by
+// dirlookup(), from the directory dp.
+// Caller must hold dp->lock.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink");
+  dcenter(dp->dev, dp->inum, name, 0);
+  if(dp->dix.npg > 0)
+    dixdel(dp, name, off);
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -621,6 +947,22 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// Look for name in directory dp, consulting the
+// directory name cache first and filling it on a miss.
+// Caller must hold dp->lock.
+static struct inode*
+dcdirlookup(struct inode *dp, char *name)
+{
+  struct inode *ip;
+  uint inum;
+
+  if(dclookup(dp->dev, dp->inum, name, &inum))
+    return inum ? iget(dp->dev, inum) : 0;
+  ip = dirlookup(dp, name, 0);
+  dcenter(dp->dev, dp->inum, name, ip ? ip->inum : 0);
+  return ip;
+}
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
@@ -646,7 +988,7 @@ namex(char *path, int nameiparent, char *name)
       iunlock(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
+    if((next = dcdirlookup(ip, name)) == 0){
       iunlockput(ip);
       return 0;
     }
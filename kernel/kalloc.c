@@ -1,6 +1,15 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Each CPU has its own free list and lock, so kalloc()
+// and kfree() on different CPUs don't contend. A CPU
+// whose list is empty steals a batch of pages from the
+// CPU with the most free pages.
+//
+// Pages carry a reference count so that copy-on-write
+// fork can share them; kfree() only frees a page when
+// its last reference is dropped.
 
 #include "types.h"
 #include "param.h"
@@ -9,6 +18,8 @@
 #include "riscv.h"
 #include "defs.h"
 
+#define NSTEAL 64  // max pages moved by one steal
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -21,12 +32,24 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;    // pages on freelist
+  int nsteal;   // steals by this CPU
+  int nstolen;  // pages stolen by this CPU
+} kmem[NCPU];
+
+// Reference counts of physical pages, indexed by
+// (pa - KERNBASE) / PGSIZE. Updated with atomic
+// instructions, so they need no lock.
+static int pageref[(PHYSTOP - KERNBASE) / PGSIZE];
+#define PA2REF(pa) (pageref[((uint64)(pa) - KERNBASE) / PGSIZE])
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem[i].lock, "kmem");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +58,100 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    PA2REF(p) = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page is freed when its last reference is dropped.
 void
 kfree(void *pa)
 {
   struct run *r;
+  int id, ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  ref = __sync_sub_and_fetch(&PA2REF(pa), 1);
+  if(ref > 0)
+    return;
+  if(ref < 0)
+    panic("kfree: ref");
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  acquire(&kmem[id].lock);
+  r->next = kmem[id].freelist;
+  kmem[id].freelist = r;
+  kmem[id].nfree++;
+  release(&kmem[id].lock);
+  pop_off();
+}
+
+// Move up to half of the free pages of the CPU with
+// the most free pages, but no more than NSTEAL, to
+// CPU id's free list, and return one of them.
+// Holds only one kmem lock at a time, so CPUs
+// stealing from each other can't deadlock.
+// Returns 0 if no CPU has a free page.
+// Caller must have interrupts off.
+static struct run*
+ksteal(int id)
+{
+  struct run *r, *head, *tail;
+  int i, n, victim, tries;
+
+  for(tries = 0; tries < NCPU; tries++){
+    // nfree is read without the lock; it is only a hint.
+    victim = -1;
+    for(i = 0; i < NCPU; i++){
+      if(i != id && kmem[i].nfree > 0 &&
+         (victim < 0 || kmem[i].nfree > kmem[victim].nfree))
+        victim = i;
+    }
+    if(victim < 0)
+      return 0;
+
+    acquire(&kmem[victim].lock);
+    n = (kmem[victim].nfree + 1) / 2;
+    if(n > NSTEAL)
+      n = NSTEAL;
+    head = tail = kmem[victim].freelist;
+    for(i = 1; i < n; i++)
+      tail = tail->next;
+    if(n > 0){
+      kmem[victim].freelist = tail->next;
+      kmem[victim].nfree -= n;
+    }
+    release(&kmem[victim].lock);
+
+    if(n == 0)
+      continue;  // another CPU emptied it first; look again.
+
+    r = head;
+    acquire(&kmem[id].lock);
+    if(n > 1){
+      tail->next = kmem[id].freelist;
+      kmem[id].freelist = r->next;
+      kmem[id].nfree += n - 1;
+    }
+    kmem[id].nsteal++;
+    kmem[id].nstolen += n;
+    release(&kmem[id].lock);
+    return r;
+  }
+  return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +161,62 @@ void *
 kalloc(void)
 {
   struct run *r;
+  int id;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  acquire(&kmem[id].lock);
+  r = kmem[id].freelist;
+  if(r){
+    kmem[id].freelist = r->next;
+    kmem[id].nfree--;
+  }
+  release(&kmem[id].lock);
+  if(r == 0)
+    r = ksteal(id);
+  pop_off();
 
-  if(r)
+  if(r){
+    PA2REF(r) = 1;
     memset((char*)r, 5, PGSIZE); // fill with junk
+  }
   return (void*)r;
 }
+
+// Add a reference to a page returned by kalloc().
+void
+kdup(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kdup");
+  if(__sync_fetch_and_add(&PA2REF(pa), 1) < 1)
+    panic("kdup: free page");
+}
+
+// Number of references to a page returned by kalloc().
+int
+krefcnt(void *pa)
+{
+  return __atomic_load_n(&PA2REF(pa), __ATOMIC_SEQ_CST);
+}
+
+// Report per-CPU free pages, steals, and lock
+// contention for /statistics.
+int
+kallocstats(char *buf, int sz)
+{
+  int i, n, nts;
+
+  n = snprintf(buf, sz, "kmem: cpu free steals stolen #acquire #test-and-set\n");
+  nts = 0;
+  for(i = 0; i < NCPU; i++){
+    if(kmem[i].lock.n == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "kmem: %d %d %d %d %d %d\n", i,
+                  kmem[i].nfree, kmem[i].nsteal, kmem[i].nstolen,
+                  kmem[i].lock.n, kmem[i].lock.nts);
+    nts += kmem[i].lock.nts;
+  }
+  n += snprintf(buf+n, sz-n, "kmem: total #test-and-set %d\n", nts);
+  return n;
+}
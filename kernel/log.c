@@ -29,6 +29,19 @@
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// Committed transactions are not installed right away.
+// Each commit appends its blocks to the log after those of
+// earlier, still uninstalled transactions and rewrites the
+// header to cover them all, so a commit costs two disk
+// requests. The blocks stay pinned in the buffer cache,
+// which therefore always holds their newest contents.
+// Once the log is more than half full, a checkpoint writes
+// the newest copy of each logged block to its home location
+// and empties the log. A block written by many transactions
+// in between is installed only once.
+// A block may be in the log more than once; recovery
+// installs only its last copy.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -44,7 +57,12 @@ struct log {
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
   int dev;
+  int committed;   // lh.block[0..committed) are on disk, not yet installed
   struct logheader lh;
+  int ncommit;     // commits
+  int nlogged;     // blocks written to the log
+  int ncheckpoint; // checkpoints
+  int ninstall;    // blocks written to their home location
 };
 struct log log;
 
@@ -64,21 +82,58 @@ initlog(int dev, struct superblock *sb)
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Is log.lh.block[i] logged again later on?
+static int
+superseded(int i)
+{
+  int j;
+
+  for (j = i+1; j < log.lh.n; j++) {
+    if (log.lh.block[j] == log.lh.block[i])
+      return 1;
+  }
+  return 0;
+}
+
+// Copy committed blocks to their home location, skipping
+// all but the last copy of a block logged more than once.
+// When recovering the blocks come from the log; otherwise
+// the pinned cache buffers already hold the newest copies.
+// Writes up to MAXOPBLOCKS blocks per batch.
 static void
 install_trans(int recovering)
 {
-  int tail;
+  struct buf *dbuf[MAXOPBLOCKS];
+  int tail, i, n;
 
+  n = 0;
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+    if (superseded(tail))
+      continue;
+    dbuf[n] = bread(log.dev, log.lh.block[tail]); // read dst
+    if (recovering) {
+      struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
+      memmove(dbuf[n]->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    }
+    if (++n == MAXOPBLOCKS || tail == log.lh.n-1) {
+      bwritev(dbuf, n);  // write dst to disk
+      for (i = 0; i < n; i++)
+        brelse(dbuf[i]);
+      log.ninstall += n;
+      n = 0;
+    }
+  }
+  if (n > 0)
+    panic("install_trans");
+
+  if (recovering == 0) {
+    // every log_write() of a new entry pinned its buffer.
+    for (tail = 0; tail < log.lh.n; tail++) {
+      struct buf *b = bread(log.dev, log.lh.block[tail]);
+      bunpin(b);
+      brelse(b);
+    }
   }
 }
 
@@ -174,37 +229,56 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy the current transaction's modified blocks from
+// cache to log, after the blocks of earlier transactions.
+// The log blocks are consecutive, so each batch
+// of up to MAXOPBLOCKS goes to the disk as one request.
 static void
 write_log(void)
 {
-  int tail;
+  struct buf *to[MAXOPBLOCKS];
+  int tail, i, n;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (tail = log.committed; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if(n > MAXOPBLOCKS)
+      n = MAXOPBLOCKS;
+    for (i = 0; i < n; i++) {
+      to[i] = bclaim(log.dev, log.start+tail+i+1); // log block, no need to read it
+      struct buf *from = bread(log.dev, log.lh.block[tail+i]); // cache block
+      memmove(to[i]->data, from->data, BSIZE);
+      brelse(from);
+    }
+    bwritev(to, n);  // write the log
+    for (i = 0; i < n; i++)
+      brelse(to[i]);
   }
 }
 
 static void
 commit()
 {
-  if (log.lh.n > 0) {
+  if (log.lh.n > log.committed) {
+    log.nlogged += log.lh.n - log.committed;
+    log.ncommit++;
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
+    log.committed = log.lh.n;
+  }
+  if (log.lh.n > LOGSIZE/2) {
+    // checkpoint, leaving room for the next transactions.
+    log.ncheckpoint++;
     install_trans(0); // Now install writes to home locations
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    log.committed = 0;
+    write_head();    // Erase the transactions from the log
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// commit()/write_log() will do the disk write, and a later
+// checkpoint will install and unpin it.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -222,7 +296,9 @@ log_write(struct buf *b)
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
-  for (i = 0; i < log.lh.n; i++) {
+  // only the current transaction's entries can absorb the
+  // write; committed ones must stay as they are on disk.
+  for (i = log.committed; i < log.lh.n; i++) {
     if (log.lh.block[i] == b->blockno)   // log absorption
       break;
   }
@@ -234,3 +310,14 @@ log_write(struct buf *b)
   release(&log.lock);
 }
 
+int
+logstats(char *buf, int sz)
+{
+  int n;
+
+  n = snprintf(buf, sz, "log: %d blocks, %d in use\n", LOGSIZE, log.lh.n);
+  n += snprintf(buf+n, sz-n, "log: commit %d logged %d\n", log.ncommit, log.nlogged);
+  n += snprintf(buf+n, sz-n, "log: checkpoint %d installed %d\n",
+                log.ncheckpoint, log.ninstall);
+  return n;
+}
@@ -0,0 +1,322 @@
+// Memory-mapped files and anonymous memory.
+//
+// mmap() only records a region in the process's vma[]
+// table, placed top-down below the trapframe. Its pages
+// are filled in on the first access by mmapfault(), called
+// for page faults by usertrap() and for kernel copies to
+// and from user memory by copyin()/copyout():
+//   - a file page is read through the buffer cache into a
+//     page of its own. A file's blocks are smaller than a
+//     page, so the buffer cache can't be mapped directly.
+//   - a MAP_ANON page is a zeroed page, like lazy sbrk().
+// A page of a MAP_SHARED mapping is mapped read-only until
+// it is first written, and is then marked PTE_DIRTY, so
+// munmap() and exit() write back only the pages that were
+// written, through the log. Processes that map the same
+// file don't see each other's writes until then; a fork
+// child shares its parent's pages.
+// MAP_PRIVATE pages are copy-on-write across fork and are
+// never written back.
+
+#include "types.h"
+#include "riscv.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "defs.h"
+
+// The region of p that contains va, or 0.
+static struct vma*
+vmafind(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr && va >= v->addr && va < v->addr + v->len)
+      return v;
+  }
+  return 0;
+}
+
+// The lowest address of any region of p: the heap must
+// stay below it.
+uint64
+mmapfloor(struct proc *p)
+{
+  struct vma *v;
+  uint64 a = TRAPFRAME;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr && v->addr < a)
+      a = v->addr;
+  }
+  return a;
+}
+
+// Map len bytes of f at offset off, or zeroed memory if
+// MAP_ANON, into the current process. The address is
+// chosen by the kernel.
+// Returns the address, or -1.
+uint64
+mmap(uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v, *w;
+  uint64 a;
+
+  if(len == 0 || len > TRAPFRAME || off % PGSIZE != 0)
+    return -1;
+  len = PGROUNDUP(len);
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(flags & MAP_ANON){
+    // a fork child would not share pages that aren't
+    // filled in yet, so only private anonymous memory.
+    if(flags & MAP_SHARED)
+      return -1;
+    f = 0;
+  } else {
+    if(f == 0 || f->type != FD_INODE || f->readable == 0)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && f->writable == 0)
+      return -1;
+  }
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0)
+      break;
+  }
+  if(v == &p->vma[NVMA])
+    return -1;
+
+  // the highest gap below the trapframe that len fits in.
+  a = TRAPFRAME - len;
+  for(w = p->vma; w < &p->vma[NVMA]; w++){
+    if(w->addr && a < w->addr + w->len && w->addr < a + len){
+      if(w->addr < len)
+        return -1;
+      a = w->addr - len;
+      w = p->vma - 1;  // check the new address from the start.
+    }
+  }
+  if(a < PGROUNDUP(p->sz))
+    return -1;
+
+  v->addr = a;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = f ? filedup(f) : 0;
+  v->off = off;
+  return a;
+}
+
+// Handle a fault at va in p, or a kernel access to it:
+// fill in the page if va is in a region, and on a write
+// to a clean MAP_SHARED page, make it writable and dirty.
+// A file page can only be read if the caller can sleep,
+// with interrupts on, and doesn't hold the file's inode
+// lock; usertrap() turns interrupts on before calling.
+// Returns 0 on success, -1 if va is not such an address,
+// the access is not allowed, or out of memory.
+int
+mmapfault(struct proc *p, uint64 va, int write)
+{
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+  int perm;
+
+  if((v = vmafind(p, va)) == 0)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if(write && (v->prot & PROT_WRITE) == 0)
+    return -1;
+
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    if(!write || (*pte & PTE_W) || (v->flags & MAP_SHARED) == 0)
+      return -1;
+    *pte |= PTE_W | PTE_DIRTY;
+    return 0;
+  }
+
+  if(v->prot == PROT_NONE)
+    return -1;
+  if(v->f && (intr_get() == 0 || holdingsleep(&v->f->ip->lock)))
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(v->f && filereadat(v->f, mem, v->off + (va - v->addr), PGSIZE) < 0){
+    kfree(mem);
+    return -1;
+  }
+
+  // the hardware has no write-only pages.
+  perm = PTE_U | PTE_R;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+  if((v->prot & PROT_WRITE) && ((v->flags & MAP_SHARED) == 0 || write))
+    perm |= PTE_W;
+  if((v->flags & MAP_SHARED) && write)
+    perm |= PTE_DIRTY;
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Fill in the file pages of p's regions that the n bytes
+// at addr overlap, before a read() or write() copies to
+// or from them while holding locks that mmapfault() can't
+// sleep with.
+void
+mmapprefault(struct proc *p, uint64 addr, uint64 n)
+{
+  struct vma *v;
+  uint64 a, start, end;
+  pte_t *pte;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0 || v->f == 0)
+      continue;
+    start = addr > v->addr ? addr : v->addr;
+    end = addr + n < v->addr + v->len ? addr + n : v->addr + v->len;
+    for(a = PGROUNDDOWN(start); a < end; a += PGSIZE){
+      if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+        mmapfault(p, a, 0);
+    }
+  }
+}
+
+// Write back the dirty pages of [va, va+len) in region v
+// of p, and unmap them.
+static int
+vmaunmap(struct proc *p, struct vma *v, uint64 va, uint64 len)
+{
+  uint64 a;
+  pte_t *pte;
+  int r = 0;
+
+  for(a = va; a < va + len; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
+    if(v->f && (v->flags & MAP_SHARED) && (*pte & PTE_DIRTY) &&
+       filewriteback(v->f, (char*)PTE2PA(*pte), v->off + (a - v->addr), PGSIZE) < 0)
+      r = -1;
+    uvmunmap(p->pagetable, a, 1, 1);
+  }
+  return r;
+}
+
+// Unmap [addr, addr+len) of p, which must be inside one
+// region, writing back MAP_SHARED pages that were written.
+// Returns 0, or -1.
+int
+munmap(struct proc *p, uint64 addr, uint64 len)
+{
+  struct vma *v, *w;
+  uint64 end;
+  int r;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  len = PGROUNDUP(len);
+  if((v = vmafind(p, addr)) == 0 || addr + len > v->addr + v->len)
+    return -1;
+  end = v->addr + v->len;
+
+  // unmapping the middle splits the region in two.
+  w = 0;
+  if(addr > v->addr && addr + len < end){
+    for(w = p->vma; w < &p->vma[NVMA]; w++){
+      if(w->addr == 0)
+        break;
+    }
+    if(w == &p->vma[NVMA])
+      return -1;
+  }
+
+  r = vmaunmap(p, v, addr, len);
+
+  if(w){
+    *w = *v;
+    w->addr = addr + len;
+    w->len = end - w->addr;
+    w->off = v->off + (w->addr - v->addr);
+    if(w->f)
+      filedup(w->f);
+    v->len = addr - v->addr;
+  } else if(addr == v->addr && len == v->len){
+    if(v->f)
+      fileclose(v->f);
+    v->addr = 0;
+  } else if(addr == v->addr){
+    v->addr += len;
+    v->len -= len;
+    v->off += len;
+  } else {
+    v->len -= len;
+  }
+  return r;
+}
+
+// Unmap all of p's regions, for exit() and exec().
+void
+mmapclear(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr)
+      munmap(p, v->addr, v->len);
+  }
+}
+
+// Give fork child np a copy of p's regions. A MAP_SHARED
+// page is shared with the child; a MAP_PRIVATE page becomes
+// copy-on-write, like uvmcopy().
+// Returns 0, or -1 with nothing copied.
+int
+mmapfork(struct proc *p, struct proc *np)
+{
+  struct vma *v;
+  uint64 a, pa;
+  pte_t *pte;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0)
+      continue;
+    np->vma[v - p->vma] = *v;
+    if(v->f)
+      filedup(v->f);
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+        continue;
+      if((v->flags & MAP_SHARED) == 0 && (*pte & PTE_W))
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+      pa = PTE2PA(*pte);
+      if(mappages(np->pagetable, a, PGSIZE, pa, PTE_FLAGS(*pte) & ~PTE_V) != 0){
+        // unmap what was copied, without writing it back.
+        for(v = np->vma; v < &np->vma[NVMA]; v++){
+          if(v->addr == 0)
+            continue;
+          uvmunmap(np->pagetable, v->addr, v->len / PGSIZE, 1);
+          if(v->f)
+            fileclose(v->f);
+          v->addr = 0;
+        }
+        return -1;
+      }
+      kdup((void*)pa);
+    }
+  }
+  return 0;
+}
@@ -7,7 +7,13 @@
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      (MAXOPBLOCKS*16)  // max data blocks in on-disk log
+#define NBUF         (LOGSIZE*2+MAXOPBLOCKS*3)  // size of disk block cache
+#define FSSIZE       200000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define RAMAX          8   // max blocks in a file's read-ahead window
+#define NDCACHE      256   // entries in the directory name cache
+#define NPRIO          3   // scheduling priority levels, 0 is highest
+#define BOOSTTICKS    20   // ticks between priority boosts
+#define PIPEMAXPG     16   // max pages in a pipe's buffer
+#define NVMA          16   // mmap()ed regions per process
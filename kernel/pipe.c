@@ -8,17 +8,67 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// A pipe's buffer is a ring of 1 to PIPEMAXPG pages, a
+// power of two so that the byte counters can wrap. Data is
+// copied a page-contiguous span at a time, and a reader
+// wakes a writer waiting for space only once half the
+// buffer is free. Writes of at most PIPEBUF bytes are not
+// interleaved with other writes.
+//
+// splice() moves data between a pipe and a file with
+// readi() or writei() straight from or to the buffer pages,
+// which can sleep, so it can't hold pi->lock meanwhile.
+// Instead it claims the writing (or reading) end with
+// wbusy (or rbusy), and the others wait until it is done.
+#define PIPEBUF 512
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *pg[PIPEMAXPG];  // buffer pages
+  uint size;      // bytes in the buffer, npages * PGSIZE
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int wbusy;      // a splice is filling free space
+  int rbusy;      // a splice is draining data
 };
 
+static void
+pipefreepages(char **pg, int npg)
+{
+  int i;
+
+  for(i = 0; i < npg; i++)
+    kfree(pg[i]);
+}
+
+// Allocate npg buffer pages into pg.
+static int
+pipeallocpages(char **pg, int npg)
+{
+  int i;
+
+  for(i = 0; i < npg; i++){
+    if((pg[i] = kalloc()) == 0){
+      pipefreepages(pg, i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Where byte number n of the stream is in the buffer, and
+// how many bytes follow it before the end of its page.
+static char*
+pipeaddr(struct pipe *pi, uint n, uint *span)
+{
+  uint off = n % pi->size;
+
+  *span = PGSIZE - off % PGSIZE;
+  return pi->pg[off / PGSIZE] + off % PGSIZE;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,10 +80,18 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  if(pipeallocpages(pi->pg, 1) < 0){
+    kfree((char*)pi);
+    pi = 0;
+    goto bad;
+  }
+  pi->size = PGSIZE;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->wbusy = 0;
+  pi->rbusy = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -46,8 +104,6 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
-  if(pi)
-    kfree((char*)pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,6 +124,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    pipefreepages(pi->pg, pi->size / PGSIZE);
     kfree((char*)pi);
   } else
     release(&pi->lock);
@@ -77,26 +134,41 @@ int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
   int i = 0;
+  uint m, space;
+  char *p;
   struct proc *pr = myproc();
 
+  // readers and writers are woken one at a time. One that
+  // leaves data or space behind wakes the next in line.
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || pr->killed){
+      wakeupone(&pi->nwrite);
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
+    space = pi->size - (pi->nwrite - pi->nread);
+    if(pi->wbusy || space == 0 || (n <= PIPEBUF && space < n)){ //DOC: pipewrite-full
+      // a small write waits for room for all of it.
+      if(pi->nwrite != pi->nread)
+        wakeupone(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      continue;
     }
+    p = pipeaddr(pi, pi->nwrite, &m);
+    if(m > space)
+      m = space;
+    if(m > n - i)
+      m = n - i;
+    if(copyin(pr->pagetable, p, addr + i, m) == -1)
+      break;
+    pi->nwrite += m;
+    i += m;
   }
-  wakeup(&pi->nread);
+  if(pi->nwrite != pi->nread)
+    wakeupone(&pi->nread);
+  if(pi->nwrite != pi->nread + pi->size)
+    wakeupone(&pi->nwrite);
   release(&pi->lock);
 
   return i;
@@ -106,25 +178,178 @@ int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
   int i;
+  uint m;
+  char *p;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+  while(pi->rbusy || (pi->nread == pi->nwrite && pi->writeopen)){  //DOC: pipe-empty
     if(pr->killed){
+      // the wakeup may have been meant for us: pass it on.
+      if(pi->nread != pi->nwrite)
+        wakeupone(&pi->nread);
       release(&pi->lock);
       return -1;
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    p = pipeaddr(pi, pi->nread, &m);
+    if(m > pi->nwrite - pi->nread)
+      m = pi->nwrite - pi->nread;
+    if(m > n - i)
+      m = n - i;
+    if(copyout(pr->pagetable, addr + i, p, m) == -1)
       break;
+    pi->nread += m;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  if(pi->nwrite - pi->nread <= pi->size / 2)
+    wakeupone(&pi->nwrite);  //DOC: piperead-wakeup
+  if(pi->nread != pi->nwrite)
+    wakeupone(&pi->nread);
   release(&pi->lock);
   return i;
 }
+
+// Set the buffer of pi to size bytes, rounded up to a
+// power of two pages, or just return the size if size is
+// 0. Fails if the data in the pipe would not fit, or while
+// a splice is using the buffer.
+// Returns the new size, or -1.
+int
+pipesize(struct pipe *pi, int size)
+{
+  char *pg[PIPEMAXPG], *p;
+  int npg, i;
+  uint m, len;
+
+  if(size < 0 || size > PIPEMAXPG * PGSIZE)
+    return -1;
+  if(size == 0)
+    return pi->size;
+  for(npg = 1; npg * PGSIZE < size; npg *= 2)
+    ;
+  if(pipeallocpages(pg, npg) < 0)
+    return -1;
+
+  acquire(&pi->lock);
+  len = pi->nwrite - pi->nread;
+  if(len > npg * PGSIZE || pi->wbusy || pi->rbusy){
+    release(&pi->lock);
+    pipefreepages(pg, npg);
+    return -1;
+  }
+  // move the data to the start of the new buffer.
+  for(i = 0; i < len; i += m){
+    p = pipeaddr(pi, pi->nread + i, &m);
+    if(m > len - i)
+      m = len - i;
+    if(m > PGSIZE - i % PGSIZE)
+      m = PGSIZE - i % PGSIZE;
+    memmove(pg[i / PGSIZE] + i % PGSIZE, p, m);
+  }
+  pipefreepages(pi->pg, pi->size / PGSIZE);
+  memmove(pi->pg, pg, sizeof(pg[0]) * npg);
+  pi->size = npg * PGSIZE;
+  pi->nread = 0;
+  pi->nwrite = len;
+  // a writer may have room now.
+  wakeupone(&pi->nwrite);
+  release(&pi->lock);
+  return pi->size;
+}
+
+// For splice(): wait for free space in pi and claim it.
+// Sets *p and *m to the free span that follows the data,
+// up to the end of its page. The caller fills some of it
+// and calls pipewend().
+// Returns 0, or -1 if the read end is closed or the
+// caller is killed.
+int
+pipewbegin(struct pipe *pi, char **p, uint *m)
+{
+  struct proc *pr = myproc();
+  uint space;
+
+  acquire(&pi->lock);
+  for(;;){
+    if(pi->readopen == 0 || pr->killed){
+      wakeupone(&pi->nwrite);
+      release(&pi->lock);
+      return -1;
+    }
+    space = pi->size - (pi->nwrite - pi->nread);
+    if(!pi->wbusy && space > 0)
+      break;
+    if(pi->nwrite != pi->nread)
+      wakeupone(&pi->nread);
+    sleep(&pi->nwrite, &pi->lock);
+  }
+  pi->wbusy = 1;
+  *p = pipeaddr(pi, pi->nwrite, m);
+  if(*m > space)
+    *m = space;
+  release(&pi->lock);
+  return 0;
+}
+
+// Add the n bytes that the caller of pipewbegin() wrote.
+void
+pipewend(struct pipe *pi, uint n)
+{
+  acquire(&pi->lock);
+  pi->nwrite += n;
+  pi->wbusy = 0;
+  if(pi->nwrite != pi->nread)
+    wakeupone(&pi->nread);
+  if(pi->nwrite != pi->nread + pi->size)
+    wakeupone(&pi->nwrite);
+  release(&pi->lock);
+}
+
+// For splice(): claim the data at the head of pi. Sets
+// *p and *m to the data up to the end of its page. The
+// caller copies some of it and calls piperend().
+// If the pipe is empty, waits for data if wait is set.
+// Returns 1, or 0 if there is no data, or -1 if the
+// caller is killed.
+int
+piperbegin(struct pipe *pi, char **p, uint *m, int wait)
+{
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(pi->rbusy || (pi->nread == pi->nwrite && pi->writeopen && wait)){
+    if(pr->killed){
+      if(pi->nread != pi->nwrite)
+        wakeupone(&pi->nread);
+      release(&pi->lock);
+      return -1;
+    }
+    sleep(&pi->nread, &pi->lock);
+  }
+  if(pi->nread == pi->nwrite){
+    release(&pi->lock);
+    return 0;
+  }
+  pi->rbusy = 1;
+  *p = pipeaddr(pi, pi->nread, m);
+  if(*m > pi->nwrite - pi->nread)
+    *m = pi->nwrite - pi->nread;
+  release(&pi->lock);
+  return 1;
+}
+
+// Remove the n bytes that the caller of piperbegin() took.
+void
+piperend(struct pipe *pi, uint n)
+{
+  acquire(&pi->lock);
+  pi->nread += n;
+  pi->rbusy = 0;
+  if(pi->nwrite - pi->nread <= pi->size / 2)
+    wakeupone(&pi->nwrite);
+  if(pi->nread != pi->nwrite || !pi->writeopen)
+    wakeupone(&pi->nread);
+  release(&pi->lock);
+}
@@ -17,6 +17,7 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -26,6 +27,79 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// Sleeping processes are kept in a hash table of queues
+// keyed by channel, so wakeup() only looks at the procs
+// that sleep on channels with the same hash, rather than
+// locking every proc in the table.
+// A queue's lock is acquired after any p->lock. wakeup()
+// unlinks sleepers under the queue lock and then wakes
+// them one p->lock at a time, holding no queue lock.
+// kill() wakes a sleeper without unlinking it; the sleeper
+// unlinks itself when it returns from sched().
+#define NSLEEPQ 61
+
+struct {
+  struct spinlock lock;
+  struct proc *head;
+} sleepq[NSLEEPQ];
+
+int nwakeup;   // calls to wakeup() and wakeupone()
+int nwoken;    // processes they woke
+
+// Each CPU has a run queue of RUNNABLE processes, with a
+// FIFO list per priority level, and scheduler() takes the
+// process at the head of the highest non-empty level.
+// A CPU whose queue is empty steals from the longest other
+// queue, and if there is nothing to steal it waits for an
+// interrupt with wfi. setrunnable() queues a process on the
+// CPU that last ran it unless that CPU is busy and another
+// is idle, and kicks the chosen CPU (or an idle one, to
+// steal) out of wfi.
+// A run queue's lock is acquired after any p->lock.
+//
+// Priorities form a multi-level feedback queue. A process
+// starts at level p->nice (0 unless set by setpriority()),
+// and drops a level each time it runs for a whole time
+// slice, which is 1<<level ticks, so processes that mostly
+// sleep, like the shell waiting in consoleread(), stay
+// ahead of CPU-bound ones. A process at a lower level
+// yields at the next tick once a higher level has work.
+// Every BOOSTTICKS ticks every process returns to its nice
+// level, so none starves.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  int n;
+  uint boost;   // boost period of the lists' levels
+  int nrun;     // processes this CPU switched to
+  int nsteal;   // of which taken from other CPUs' queues
+  int nidle;    // times it waited in wfi
+  int nkick;    // times other CPUs kicked it
+} runq[NCPU];
+
+// The current boost period; see struct runq.
+static uint
+boostperiod(void)
+{
+  return ticks / BOOSTTICKS;
+}
+
+// Return p to its nice level if a boost has happened
+// since its level was last set.
+// Caller must hold p->lock.
+static void
+boostcheck(struct proc *p)
+{
+  uint b = boostperiod();
+
+  if(p->boost != b){
+    p->boost = b;
+    p->prio = p->nice;
+    p->used = 0;
+  }
+}
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -50,6 +124,10 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
@@ -163,6 +241,8 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->nice = p->prio = p->used = 0;
+  p->rticks = p->wticks = 0;
   p->state = UNUSED;
 }
 
@@ -242,7 +322,8 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  p->cpu = 0;
+  setrunnable(p);
 
   release(&p->lock);
 }
@@ -252,7 +333,7 @@ userinit(void)
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
@@ -289,6 +370,12 @@ fork(void)
   }
   np->sz = p->sz;
 
+  if(mmapfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -312,7 +399,10 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->cpu = cpuid();
+  np->nice = np->prio = p->nice;
+  np->boost = boostperiod();
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -344,6 +434,9 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // Unmap mmap()ed regions, writing back shared files.
+  mmapclear(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -427,6 +520,188 @@ wait(uint64 addr)
   }
 }
 
+// Append p to the tail of its level in CPU id's run queue.
+// Caller must hold p->lock.
+static void
+rqpush(int id, struct proc *p)
+{
+  struct runq *rq = &runq[id];
+
+  acquire(&rq->lock);
+  p->cpu = id;
+  p->rqnext = 0;
+  if(rq->tail[p->prio])
+    rq->tail[p->prio]->rqnext = p;
+  else
+    rq->head[p->prio] = p;
+  rq->tail[p->prio] = p;
+  rq->n++;
+  release(&rq->lock);
+}
+
+// Take the process at the head of the highest level of
+// CPU id's run queue.
+static struct proc*
+rqpop(int id)
+{
+  struct runq *rq = &runq[id];
+  struct proc *p;
+  int i;
+
+  if(rq->n == 0)   // peek without the lock; rechecked below.
+    return 0;
+  acquire(&rq->lock);
+  if(rq->boost != boostperiod()){
+    // everyone queued is boosted: move the lower levels to
+    // the end of level 0. scheduler() resets their p->prio.
+    rq->boost = boostperiod();
+    for(i = 1; i < NPRIO; i++){
+      if(rq->head[i] == 0)
+        continue;
+      if(rq->tail[0])
+        rq->tail[0]->rqnext = rq->head[i];
+      else
+        rq->head[0] = rq->head[i];
+      rq->tail[0] = rq->tail[i];
+      rq->head[i] = rq->tail[i] = 0;
+    }
+  }
+  p = 0;
+  for(i = 0; i < NPRIO; i++){
+    if((p = rq->head[i]) != 0){
+      if((rq->head[i] = p->rqnext) == 0)
+        rq->tail[i] = 0;
+      p->rqnext = 0;
+      rq->n--;
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Take p out of CPU id's run queue, at whatever level a
+// boost left it. Returns 0 if p is not queued there, as
+// when scheduler() has popped it but not yet locked it.
+// Caller must hold p->lock.
+static int
+rqremove(int id, struct proc *p)
+{
+  struct runq *rq = &runq[id];
+  struct proc **pp, *prev;
+  int i;
+
+  acquire(&rq->lock);
+  for(i = 0; i < NPRIO; i++){
+    prev = 0;
+    for(pp = &rq->head[i]; *pp; pp = &(*pp)->rqnext){
+      if(*pp != p){
+        prev = *pp;
+        continue;
+      }
+      *pp = p->rqnext;
+      if(rq->tail[i] == p)
+        rq->tail[i] = prev;
+      p->rqnext = 0;
+      rq->n--;
+      release(&rq->lock);
+      return 1;
+    }
+  }
+  release(&rq->lock);
+  return 0;
+}
+
+// Is a process of a higher level than prio queued on CPU id?
+static int
+rqhigher(int id, int prio)
+{
+  struct runq *rq = &runq[id];
+  int i;
+
+  if(rq->n == 0)
+    return 0;
+  for(i = 0; i < prio; i++){
+    if(rq->head[i])
+      return 1;
+  }
+  return 0;
+}
+
+// Take a process from the longest run queue of another CPU.
+static struct proc*
+rqsteal(int self)
+{
+  int i, best = -1;
+
+  for(i = 0; i < NCPU; i++){
+    if(i != self && runq[i].n > 0 && (best < 0 || runq[i].n > runq[best].n))
+      best = i;
+  }
+  return best < 0 ? 0 : rqpop(best);
+}
+
+// Does another CPU have processes queued?
+static int
+rqsteal_peek(int self)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++){
+    if(i != self && runq[i].n > 0)
+      return runq[i].n;
+  }
+  return 0;
+}
+
+static void
+kick(int id)
+{
+  if(id != cpuid()){
+    runq[id].nkick++;
+    cpukick(id);
+  }
+}
+
+// Make p RUNNABLE and put it on a run queue.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  int i, id;
+
+  p->state = RUNNABLE;
+  p->qtime = ticks;
+  boostcheck(p);
+
+  push_off();
+  // stay on the CPU whose caches hold p's state, unless
+  // it is busy while another CPU is idle.
+  id = p->cpu;
+  if(!cpus[id].idle || runq[id].n > 0){
+    for(i = 0; i < NCPU; i++){
+      if(cpus[i].idle && runq[i].n == 0){
+        id = i;
+        break;
+      }
+    }
+  }
+  rqpush(id, p);
+  __sync_synchronize();
+  if(cpus[id].idle){
+    kick(id);
+  } else {
+    // let an idle CPU, if any, steal p.
+    for(i = 0; i < NCPU; i++){
+      if(cpus[i].idle){
+        kick(i);
+        break;
+      }
+    }
+  }
+  pop_off();
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -439,29 +714,68 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+    if((p = rqpop(id)) == 0 && (p = rqsteal(id)) != 0)
+      runq[id].nsteal++;
+
+    if(p == 0){
+      // nothing to run: wait for an interrupt. with interrupts
+      // off, a kick that arrives after the queues were checked
+      // still ends the wfi, and is taken by intr_on() above.
+      intr_off();
+      c->idle = 1;
+      __sync_synchronize();
+      if(runq[id].n == 0 && rqsteal_peek(id) == 0){
+        runq[id].nidle++;
+        timeridle();
+        asm volatile("wfi");
       }
-      release(&p->lock);
+      c->idle = 0;
+      continue;
     }
+
+    // It is the process's job to release its lock and
+    // then reacquire it before jumping back to us.
+    // p may still be switching out on the CPU that
+    // queued it; acquire() waits for that to finish.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+    p->wticks += ticks - p->qtime;
+    boostcheck(p);
+    p->state = RUNNING;
+    p->cpu = id;
+    c->proc = p;
+    runq[id].nrun++;
+    timerbusy();
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
+  }
+}
+
+int
+schedstats(char *buf, int sz)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < NCPU; i++){
+    if(runq[i].nrun == 0 && runq[i].nidle == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "sched: cpu %d run %d steal %d idle %d kicked %d\n",
+                  i, runq[i].nrun, runq[i].nsteal, runq[i].nidle, runq[i].nkick);
   }
+  return n;
 }
 
 // Switch to scheduler.  Must hold only p->lock
@@ -491,13 +805,65 @@ sched(void)
   mycpu()->intena = intena;
 }
 
+// Charge a timer tick to the current process. Give up the
+// CPU if it has used up its time slice, which also lowers
+// its priority, or if a higher-priority process is waiting.
+void
+timeslice(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&p->lock);
+  p->rticks++;
+  if(++p->used >= (1 << p->prio)){
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->used = 0;
+  } else if(!rqhigher(cpuid(), p->prio)){
+    release(&p->lock);
+    return;
+  }
+  setrunnable(p);
+  sched();
+  release(&p->lock);
+}
+
+// Set the highest priority level process pid may run at,
+// 0 (highest) to NPRIO-1, and move it to that level,
+// requeueing it there if it is waiting to run.
+// Returns the previous setting, or -1.
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+  int old;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED && p->state != ZOMBIE){
+      old = p->nice;
+      p->nice = prio;
+      p->prio = prio;
+      p->used = 0;
+      if(p->state == RUNNABLE && rqremove(p->cpu, p))
+        rqpush(p->cpu, p);
+      release(&p->lock);
+      return old;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -523,53 +889,163 @@ forkret(void)
   usertrapret();
 }
 
+static int
+sleepqhash(void *chan)
+{
+  return ((uint64)chan >> 3) % NSLEEPQ;
+}
+
+// Remove p from queue q, if it is there.
+// Caller must hold q->lock.
+static void
+sleepqremove(int q, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &sleepq[q].head; *pp; pp = &(*pp)->qnext){
+    if(*pp == p){
+      *pp = p->qnext;
+      p->qnext = 0;
+      return;
+    }
+  }
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct proc **pp;
+  int q = sleepqhash(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // Once we hold p->lock and are in chan's
+  // queue, we can be guaranteed that we won't
+  // miss any wakeup (wakeup finds us in the
+  // queue, and then locks p->lock),
   // so it's okay to release lk.
 
   acquire(&p->lock);  //DOC: sleeplock1
+  acquire(&sleepq[q].lock);
+  // at the tail, so that wakeupone() is first come, first served.
+  for(pp = &sleepq[q].head; *pp; pp = &(*pp)->qnext)
+    ;
+  *pp = p;
+  p->qnext = 0;
+  p->chan = chan;
+  release(&sleepq[q].lock);
   release(lk);
 
   // Go to sleep.
-  p->chan = chan;
   p->state = SLEEPING;
 
   sched();
 
-  // Tidy up.
+  // Tidy up. Still queued if woken by kill().
+  acquire(&sleepq[q].lock);
+  sleepqremove(q, p);
   p->chan = 0;
+  release(&sleepq[q].lock);
 
   // Reacquire original lock.
   release(&p->lock);
   acquire(lk);
 }
 
+// Make p runnable if it is still sleeping on chan.
+// Returns 1 if it was.
+static int
+wakeproc(struct proc *p, void *chan)
+{
+  int woken = 0;
+
+  acquire(&p->lock);
+  if(p->state == SLEEPING && p->chan == chan) {
+    setrunnable(p);
+    woken = 1;
+  }
+  release(&p->lock);
+  return woken;
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct proc *p, *woke[NPROC];
+  struct proc **pp;
+  int q = sleepqhash(chan);
+  int i, n;
+
+  __sync_fetch_and_add(&nwakeup, 1);
+  n = 0;
+  acquire(&sleepq[q].lock);
+  for(pp = &sleepq[q].head; (p = *pp) != 0; ){
+    if(p->chan == chan && p != myproc()){
+      *pp = p->qnext;
+      p->qnext = 0;
+      woke[n++] = p;
+    } else {
+      pp = &p->qnext;
+    }
+  }
+  release(&sleepq[q].lock);
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+  for(i = 0; i < n; i++){
+    if(wakeproc(woke[i], chan))
+      __sync_fetch_and_add(&nwoken, 1);
+  }
+}
+
+// Wake up the process that has slept longest on chan,
+// for channels where one waker can only satisfy one
+// sleeper, such as a sleep-lock being released.
+// Must be called without any p->lock.
+void
+wakeupone(void *chan)
+{
+  struct proc *p, **pp;
+  int q = sleepqhash(chan);
+
+  __sync_fetch_and_add(&nwakeup, 1);
+  for(;;){
+    acquire(&sleepq[q].lock);
+    for(pp = &sleepq[q].head; (p = *pp) != 0; pp = &p->qnext){
+      if(p->chan == chan && p != myproc()){
+        *pp = p->qnext;
+        p->qnext = 0;
+        break;
       }
-      release(&p->lock);
     }
+    release(&sleepq[q].lock);
+    if(p == 0)
+      return;
+    // p may have been woken by kill() meanwhile;
+    // then try the next one.
+    if(wakeproc(p, chan)){
+      __sync_fetch_and_add(&nwoken, 1);
+      return;
+    }
+  }
+}
+
+int
+sleepqstats(char *buf, int sz)
+{
+  int i, n, acq, nts;
+
+  acq = nts = 0;
+  for(i = 0; i < NSLEEPQ; i++){
+    acq += sleepq[i].lock.n;
+    nts += sleepq[i].lock.nts;
   }
+  n = snprintf(buf, sz, "sleepq: wakeup %d woken %d\n", nwakeup, nwoken);
+  n += snprintf(buf+n, sz-n, "sleepq: #acquire %d #test-and-set %d\n", acq, nts);
+  return n;
 }
 
 // Kill the process with the given pid.
@@ -586,7 +1062,7 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable(p);
       }
       release(&p->lock);
       return 0;
@@ -650,7 +1126,8 @@ procdump(void)
       state = states[p->state];
     else
       state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
+    printf("%d %s %s prio %d run %d wait %d", p->pid, state, p->name,
+           p->prio, p->rticks, p->wticks);
     printf("\n");
   }
 }
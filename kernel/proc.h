@@ -24,6 +24,7 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int idle;                   // In scheduler() with nothing to run?
 };
 
 extern struct cpu cpus[NCPU];
@@ -80,6 +81,16 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A region of the address space made by mmap().
+struct vma {
+  uint64 addr;                 // Start, page-aligned; 0 if the slot is free
+  uint64 len;                  // Length, a multiple of PGSIZE
+  int prot;                    // PROT_ bits
+  int flags;                   // MAP_ bits
+  struct file *f;              // Mapped file, 0 for MAP_ANON
+  uint off;                    // File offset of addr
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -89,13 +100,33 @@ struct proc {
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
+                               // (and set under its sleep queue's lock)
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int nice;                    // Highest priority level it may run at
+  int prio;                    // Current priority level, nice..NPRIO-1
+  int used;                    // Ticks run at this level
+  uint boost;                  // Boost period prio was last reset in
+  uint rticks;                 // Ticks spent running
+  uint wticks;                 // Ticks spent RUNNABLE, waiting to run
+  uint qtime;                  // When it was last made RUNNABLE
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
 
+  // the lock of p->chan's sleep queue must be held when using this:
+  struct proc *qnext;          // Next proc in the sleep queue
+
+  // the lock of runq[p->cpu] must be held when using this:
+  struct proc *rqnext;         // Next proc in the run queue
+  int cpu;                     // CPU that last ran it, or whose queue it is on
+
+  // the lock of the timers[] it sleeps on in timersleep()
+  // must be held when using these:
+  uint64 deadline;             // mtime to wake at, 0 if not sleeping
+  int tidx;                    // Index in the timers' heap
+
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
@@ -104,5 +135,6 @@ struct proc {
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct vma vma[NVMA];        // mmap()ed regions
   char name[16];               // Process name (debugging)
 };
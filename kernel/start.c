@@ -11,7 +11,7 @@ void timerinit();
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+uint64 timer_scratch[NCPU][6];
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
@@ -64,17 +64,20 @@ timerinit()
   // each CPU has a separate source of timer interrupts.
   int id = r_mhartid();
 
-  // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  // no timer interrupt until the kernel asks for one
+  // by writing MTIMECMP; see timer.c. timervec disarms
+  // the timer again each time it fires.
+  *(uint64*)CLINT_MTIMECMP(id) = (uint64)-1;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
-  // scratch[4] : desired interval (in cycles) between timer interrupts.
+  // scratch[4] : address of CLINT MSIP register.
+  // scratch[5] : set by timervec when the timer fires; see timerfired().
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
-  scratch[4] = interval;
+  scratch[4] = CLINT_MSIP(id);
+  scratch[5] = 0;
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -83,6 +86,24 @@ timerinit()
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer interrupts, and software
+  // interrupts, which other CPUs send with cpukick().
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
+}
+
+// Did this CPU's timer fire since the last call?
+// Called by devintr() in supervisor mode, since timervec
+// raises the same software interrupt for a kick.
+int
+timerfired(void)
+{
+  return __sync_lock_test_and_set(&timer_scratch[cpuid()][5], 0) != 0;
+}
+
+// Interrupt CPU id, e.g. to make it leave wfi in the
+// scheduler. Arrives in devintr() as a software interrupt.
+void
+cpukick(int id)
+{
+  *(volatile uint32*)CLINT_MSIP(id) = 1;
 }
@@ -9,3 +9,13 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+// getdents() with GD_STAT fills the buffer with these,
+// a directory entry followed by the entry's stat.
+#define GD_STAT 1
+
+struct dirstat {
+  ushort inum;
+  char name[14];  // DIRSIZ
+  struct stat st;
+};
@@ -0,0 +1,82 @@
+//
+// the statistics device.
+// reading /statistics returns a text report built
+// from the counters each subsystem keeps, e.g. lock
+// contention in the page allocator.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define STATSBUF 4096
+
+struct {
+  struct spinlock lock;
+  char buf[STATSBUF];
+  int sz;   // bytes of report in buf
+  int off;  // bytes already handed to readers
+} stats;
+
+// each function appends its report to buf, writing at
+// most sz bytes, and returns the number of bytes written.
+static int (*statsfn[])(char*, int) = {
+  kallocstats,
+  bcachestats,
+  dcachestats,
+  logstats,
+  sleepqstats,
+  schedstats,
+  timerstats,
+  virtio_disk_stats,
+};
+
+static int
+statswrite(int user_src, uint64 src, int n)
+{
+  return -1;
+}
+
+// a read at the start of the report takes a fresh snapshot.
+// returns 0 (end of file) once the whole report has been read,
+// and starts over on the next read.
+static int
+statsread(int user_dst, uint64 dst, int n)
+{
+  int i, m;
+
+  acquire(&stats.lock);
+  if(stats.off == 0){
+    stats.sz = 0;
+    for(i = 0; i < NELEM(statsfn); i++)
+      stats.sz += statsfn[i](stats.buf + stats.sz, STATSBUF - stats.sz);
+  }
+
+  m = stats.sz - stats.off;
+  if(m > n)
+    m = n;
+  if(m > 0 && either_copyout(user_dst, dst, stats.buf + stats.off, m) == -1){
+    release(&stats.lock);
+    return -1;
+  }
+  stats.off += m;
+  if(m == 0)
+    stats.off = 0;
+  release(&stats.lock);
+
+  return m;
+}
+
+void
+statsinit(void)
+{
+  initlock(&stats.lock, "stats");
+
+  devsw[STATS].read = statsread;
+  devsw[STATS].write = statswrite;
+}
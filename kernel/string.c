@@ -1,13 +1,37 @@
 #include "types.h"
 
+// memset, memmove and memcpy move 8 bytes at a time, four
+// words per loop iteration, once dst (and src) are 8-byte
+// aligned, and a byte at a time for the unaligned head and
+// the tail. If dst and src are not aligned alike, they copy
+// bytes, since misaligned loads and stores trap on RISC-V.
+
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = dst;
+  uint64 w, *wd;
+
+  for(; n > 0 && ((uint64)d & 7); n--)
+    *d++ = c;
+  if(n >= 8){
+    w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    wd = (uint64*)d;
+    for(; n >= 32; n -= 32, wd += 4){
+      wd[0] = w;
+      wd[1] = w;
+      wd[2] = w;
+      wd[3] = w;
+    }
+    for(; n >= 8; n -= 8)
+      *wd++ = w;
+    d = (uchar*)wd;
   }
+  for(; n > 0; n--)
+    *d++ = c;
   return dst;
 }
 
@@ -27,25 +51,78 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
+static void
+copyfwd(uchar *d, const uchar *s, uint n)
+{
+  uint64 *wd;
+  const uint64 *ws;
+
+  if((((uint64)d ^ (uint64)s) & 7) == 0){
+    for(; n > 0 && ((uint64)d & 7); n--)
+      *d++ = *s++;
+    wd = (uint64*)d;
+    ws = (const uint64*)s;
+    for(; n >= 32; n -= 32, wd += 4, ws += 4){
+      wd[0] = ws[0];
+      wd[1] = ws[1];
+      wd[2] = ws[2];
+      wd[3] = ws[3];
+    }
+    for(; n >= 8; n -= 8)
+      *wd++ = *ws++;
+    d = (uchar*)wd;
+    s = (const uchar*)ws;
+  }
+  for(; n > 0; n--)
+    *d++ = *s++;
+}
+
+// copy from the end, for a dst that overlaps the end of src.
+static void
+copybwd(uchar *d, const uchar *s, uint n)
+{
+  uint64 *wd;
+  const uint64 *ws;
+
+  d += n;
+  s += n;
+  if((((uint64)d ^ (uint64)s) & 7) == 0){
+    for(; n > 0 && ((uint64)d & 7); n--)
+      *--d = *--s;
+    wd = (uint64*)d;
+    ws = (const uint64*)s;
+    for(; n >= 32; n -= 32){
+      wd -= 4;
+      ws -= 4;
+      wd[3] = ws[3];
+      wd[2] = ws[2];
+      wd[1] = ws[1];
+      wd[0] = ws[0];
+    }
+    for(; n >= 8; n -= 8)
+      *--wd = *--ws;
+    d = (uchar*)wd;
+    s = (const uchar*)ws;
+  }
+  for(; n > 0; n--)
+    *--d = *--s;
+}
+
 void*
 memmove(void *dst, const void *src, uint n)
 {
-  const char *s;
-  char *d;
+  const uchar *s;
+  uchar *d;
 
   if(n == 0)
     return dst;
   
   s = src;
   d = dst;
-  if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+  if(s < d && s + n > d)
+    copybwd(d, s, n);
+  else
+    copyfwd(d, s, n);
 
   return dst;
 }
@@ -54,7 +131,8 @@ memmove(void *dst, const void *src, uint n)
 void*
 memcpy(void *dst, const void *src, uint n)
 {
-  return memmove(dst, src, n);
+  copyfwd(dst, src, n);
+  return dst;
 }
 
 int
@@ -85,6 +85,14 @@ argstr(int n, char *buf, int max)
 
 extern uint64 sys_chdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_nanotime(void);
+extern uint64 sys_pipesize(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
 extern uint64 sys_dup(void);
 extern uint64 sys_exec(void);
 extern uint64 sys_exit(void);
@@ -127,6 +135,14 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_getdents] sys_getdents,
+[SYS_setpriority] sys_setpriority,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_nanotime] sys_nanotime,
+[SYS_pipesize] sys_pipesize,
+[SYS_splice]  sys_splice,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
 };
 
 void
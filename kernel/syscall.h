@@ -20,3 +20,11 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_getdents 22
+#define SYS_setpriority 23
+#define SYS_nanosleep 24
+#define SYS_nanotime 25
+#define SYS_pipesize 26
+#define SYS_splice 27
+#define SYS_mmap   28
+#define SYS_munmap 29
@@ -75,6 +75,8 @@ sys_read(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
+  if(n > 0)
+    mmapprefault(myproc(), p, n);
   return fileread(f, p, n);
 }
 
@@ -87,6 +89,8 @@ sys_write(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
+  if(n > 0)
+    mmapprefault(myproc(), p, n);
 
   return filewrite(f, p, n);
 }
@@ -115,6 +119,19 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// getdents(fd, buf, n, flags): read directory entries.
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  int n, flags;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &flags) < 0)
+    return -1;
+  return filegetdents(f, p, n, flags);
+}
+
 // Create the path new as a link to the same inode as old.
 uint64
 sys_link(void)
@@ -185,7 +202,6 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
@@ -215,9 +231,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -484,3 +498,59 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// set the buffer size of the pipe that fd is an end of,
+// or return it if the size is 0.
+uint64
+sys_pipesize(void)
+{
+  struct file *f;
+  int size;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &size) < 0)
+    return -1;
+  if(f->type != FD_PIPE)
+    return -1;
+  return pipesize(f->pipe, size);
+}
+
+// move up to n bytes from fdin to fdout, where one is
+// a pipe and the other a file, inside the kernel.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// map a file, or anonymous memory if flags has MAP_ANON
+// (and fd is ignored), at an address the kernel chooses.
+// the address argument is only a hint, and is ignored.
+uint64
+sys_mmap(void)
+{
+  struct file *f = 0;
+  uint64 len;
+  int prot, flags, fd, off;
+
+  if(argaddr(1, &len) < 0 || argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+     argint(4, &fd) < 0 || argint(5, &off) < 0 || off < 0)
+    return -1;
+  if((flags & MAP_ANON) == 0 && argfd(4, 0, &f) < 0)
+    return -1;
+  return mmap(len, prot, flags, f, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0)
+    return -1;
+  return munmap(myproc(), addr, len);
+}
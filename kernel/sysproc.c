@@ -38,17 +38,28 @@ sys_wait(void)
   return wait(p);
 }
 
+// grow lazily: only move p->sz, and let usertrap()
+// allocate a zeroed page when one is first touched.
 uint64
 sys_sbrk(void)
 {
-  int addr;
+  uint64 addr;
   int n;
+  struct proc *p = myproc();
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
-    return -1;
+  addr = p->sz;
+  if(n > 0){
+    if(addr + n > mmapfloor(p))
+      return -1;
+    p->sz += n;
+  } else if(n < 0){
+    if(addr < -(uint64)n)
+      return -1;
+    if(growproc(n) < 0)
+      return -1;
+  }
   return addr;
 }
 
@@ -56,21 +67,31 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n < 0)
+    n = 0;
+  return timersleep((uint64)n * TICKCYCLES);
+}
+
+// sleep for a number of nanoseconds, at the resolution
+// of mtime (100ns in qemu).
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  return timersleep((ns + 1000000000/MTIMEHZ - 1) / (1000000000/MTIMEHZ));
+}
+
+// return nanoseconds since boot, read from mtime.
+uint64
+sys_nanotime(void)
+{
+  return mtime() * (1000000000/MTIMEHZ);
 }
 
 uint64
@@ -83,15 +104,19 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
-// since start.
 uint64
-sys_uptime(void)
+sys_setpriority(void)
 {
-  uint xticks;
+  int pid, prio;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  if(argint(0, &pid) < 0 || argint(1, &prio) < 0)
+    return -1;
+  return setpriority(pid, prio);
+}
+
+// return how many ticks have passed since start.
+uint64
+sys_uptime(void)
+{
+  return uptime();
 }
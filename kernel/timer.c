@@ -0,0 +1,238 @@
+// Timers.
+//
+// Each CPU programs its own CLINT_MTIMECMP for just the
+// next thing it needs a timer interrupt for, rather than
+// taking an interrupt every tick:
+//   - the end of the running process's time slice, a tick
+//     after it was last started, only while the CPU runs
+//     a process. An idle CPU takes no tick interrupts.
+//   - the earliest deadline of the processes sleeping in
+//     timersleep() that it queued, kept in a min-heap.
+// timervec in kernelvec.S disarms the comparator when it
+// fires, and devintr() calls timerintr(), which wakes the
+// expired sleepers and arms the comparator again.
+//
+// Deadlines are in mtime cycles, MTIMEHZ per second. ticks
+// is derived from mtime, so it needs no CPU to count it.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NEVER ((uint64)-1)
+
+struct {
+  struct spinlock lock;
+  struct proc *heap[NPROC];  // sleepers, earliest p->deadline first
+  int n;
+  uint64 tick;               // end of the time slice, 0 when idle
+  int nintr;                 // timer interrupts
+  int ntick;                 // of which ended a time slice
+  int nexpire;               // sleepers woken
+} timers[NCPU];
+
+void
+timerqinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&timers[i].lock, "timers");
+}
+
+uint64
+mtime(void)
+{
+  return *(volatile uint64*)CLINT_MTIME;
+}
+
+// Bring ticks up to date with mtime.
+static void
+tickupdate(void)
+{
+  acquire(&tickslock);
+  ticks = mtime() / TICKCYCLES;
+  release(&tickslock);
+}
+
+uint
+uptime(void)
+{
+  tickupdate();
+  return ticks;
+}
+
+// The heap of timers[id] is ordered by p->deadline, and
+// p->tidx is p's index in it.
+
+static void
+heapset(int id, int i, struct proc *p)
+{
+  timers[id].heap[i] = p;
+  p->tidx = i;
+}
+
+static void
+siftup(int id, int i)
+{
+  struct proc *p = timers[id].heap[i];
+
+  while(i > 0 && timers[id].heap[(i-1)/2]->deadline > p->deadline){
+    heapset(id, i, timers[id].heap[(i-1)/2]);
+    i = (i-1)/2;
+  }
+  heapset(id, i, p);
+}
+
+static void
+siftdown(int id, int i)
+{
+  struct proc *p = timers[id].heap[i];
+  int c, n = timers[id].n;
+
+  while((c = 2*i + 1) < n){
+    if(c+1 < n && timers[id].heap[c+1]->deadline < timers[id].heap[c]->deadline)
+      c++;
+    if(timers[id].heap[c]->deadline >= p->deadline)
+      break;
+    heapset(id, i, timers[id].heap[c]);
+    i = c;
+  }
+  heapset(id, i, p);
+}
+
+// Remove p from the heap of timers[id].
+static void
+heapdel(int id, struct proc *p)
+{
+  int i = p->tidx;
+
+  p->deadline = 0;
+  if(i == --timers[id].n)
+    return;
+  heapset(id, i, timers[id].heap[timers[id].n]);
+  siftdown(id, i);
+  siftup(id, timers[id].heap[i]->tidx);
+}
+
+// Program this CPU's comparator for its next deadline.
+// Caller must hold timers[id].lock, or have interrupts off.
+static void
+timerarm(int id)
+{
+  uint64 next = NEVER;
+
+  if(timers[id].tick)
+    next = timers[id].tick;
+  if(timers[id].n > 0 && timers[id].heap[0]->deadline < next)
+    next = timers[id].heap[0]->deadline;
+  *(volatile uint64*)CLINT_MTIMECMP(id) = next;
+}
+
+// scheduler() is about to run a process: start a time
+// slice unless one is already running.
+// Called with interrupts off.
+void
+timerbusy(void)
+{
+  int id = cpuid();
+
+  if(timers[id].tick == 0){
+    timers[id].tick = mtime() + TICKCYCLES;
+    timerarm(id);
+  }
+}
+
+// scheduler() has nothing to run: stop the tick.
+// Called with interrupts off.
+void
+timeridle(void)
+{
+  int id = cpuid();
+
+  if(timers[id].tick != 0){
+    timers[id].tick = 0;
+    timerarm(id);
+  }
+}
+
+// The comparator fired: wake expired sleepers and arm it
+// again. Returns 2 if the time slice is over, else 1.
+// Called from devintr() with interrupts off.
+int
+timerintr(void)
+{
+  int id = cpuid(), r = 1;
+  uint64 now = mtime();
+  struct proc *p;
+
+  tickupdate();
+  acquire(&timers[id].lock);
+  timers[id].nintr++;
+  while(timers[id].n > 0 && (p = timers[id].heap[0])->deadline <= now){
+    heapdel(id, p);
+    timers[id].nexpire++;
+    wakeup(&p->deadline);
+  }
+  if(timers[id].tick && timers[id].tick <= now){
+    timers[id].tick = now + TICKCYCLES;
+    timers[id].ntick++;
+    r = 2;
+  }
+  timerarm(id);
+  release(&timers[id].lock);
+  return r;
+}
+
+// Sleep for cycles mtime cycles.
+// Returns -1 if killed first, else 0.
+int
+timersleep(uint64 cycles)
+{
+  struct proc *p = myproc();
+  int id;
+
+  if(cycles == 0)
+    return 0;
+  push_off();
+  id = cpuid();
+  acquire(&timers[id].lock);
+  pop_off();
+
+  p->deadline = mtime() + cycles;
+  timers[id].heap[timers[id].n++] = p;
+  siftup(id, timers[id].n - 1);
+  if(timers[id].heap[0] == p)
+    timerarm(id);
+
+  // timerintr() on CPU id clears p->deadline.
+  while(p->deadline != 0){
+    if(p->killed){
+      heapdel(id, p);
+      release(&timers[id].lock);
+      return -1;
+    }
+    sleep(&p->deadline, &timers[id].lock);
+  }
+  release(&timers[id].lock);
+  return 0;
+}
+
+int
+timerstats(char *buf, int sz)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < NCPU; i++){
+    if(timers[i].nintr == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "timer: cpu %d interrupts %d slices %d expired %d\n",
+                  i, timers[i].nintr, timers[i].ntick, timers[i].nexpire);
+  }
+  return n;
+}
@@ -29,6 +29,16 @@ trapinithart(void)
   w_stvec((uint64)kernelvec);
 }
 
+// A trap from user space that the kernel can't handle:
+// kill the process.
+static void
+badtrap(struct proc *p, uint64 scause, uint64 stval)
+{
+  printf("usertrap(): unexpected scause %p pid=%d\n", scause, p->pid);
+  printf("            sepc=%p stval=%p\n", p->trapframe->epc, stval);
+  p->killed = 1;
+}
+
 //
 // handle an interrupt, exception, or system call from user space.
 // called from trampoline.S
@@ -37,6 +47,7 @@ void
 usertrap(void)
 {
   int which_dev = 0;
+  uint64 scause, stval;
 
   if((r_sstatus() & SSTATUS_SPP) != 0)
     panic("usertrap: not from user mode");
@@ -49,8 +60,12 @@ usertrap(void)
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
+
+  // an interrupt taken in the kernel overwrites these.
+  scause = r_scause();
+  stval = r_stval();
   
-  if(r_scause() == 8){
+  if(scause == 8){
     // system call
 
     if(p->killed)
@@ -67,18 +82,29 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(scause == 15 && uvmcow(p->pagetable, stval) == 0){
+    // store to a copy-on-write page; it now has its own copy.
+  } else if((scause == 13 || scause == 15) &&
+            uvmlazy(p->pagetable, stval, p->sz) == 0){
+    // first touch of a page that sbrk() handed out lazily.
+  } else if(scause == 12 || scause == 13 || scause == 15){
+    // first touch of an mmap()ed page, or first write
+    // to a MAP_SHARED one. reading a file page sleeps,
+    // so turn on interrupts, as for a system call.
+    intr_on();
+    if(mmapfault(p, stval, scause == 15) != 0)
+      badtrap(p, scause, stval);
   } else {
-    printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
-    printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
-    p->killed = 1;
+    badtrap(p, scause, stval);
   }
 
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
+  // charge a timer interrupt to the process, which gives
+  // up the CPU if its time slice is over.
   if(which_dev == 2)
-    yield();
+    timeslice();
 
   usertrapret();
 }
@@ -149,9 +175,10 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
+  // charge a timer interrupt to the process, which gives
+  // up the CPU if its time slice is over.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+    timeslice();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -159,18 +186,9 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
-void
-clockintr()
-{
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
-}
-
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
+// returns 2 if a timer interrupt ended the time slice,
 // 1 if other device,
 // 0 if not recognized.
 int
@@ -201,18 +219,20 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or from another CPU's kick, forwarded by timervec in
+    // kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip, before timerfired() so that
+    // a timer interrupt arriving meanwhile is not lost.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // a kick only needs to wake the CPU up.
+    if(!timerfired())
+      return 1;
+
+    return timerintr();
   } else {
     return 0;
   }
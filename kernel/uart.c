@@ -38,12 +38,15 @@
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
+#define UART_FIFO_SIZE 16     // bytes the transmit FIFO holds
+
 // the transmit output buffer.
 struct spinlock uart_tx_lock;
-#define UART_TX_BUF_SIZE 32
+#define UART_TX_BUF_SIZE 1024
 char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
+int uart_tx_waiting; // uartwrite() is sleeping for space
 
 extern volatile int panicked; // from printf.c
 
@@ -77,15 +80,17 @@ uartinit(void)
   initlock(&uart_tx_lock, "uart");
 }
 
-// add a character to the output buffer and tell the
+// add n characters to the output buffer and tell the
 // UART to start sending if it isn't already.
-// blocks if the output buffer is full.
+// blocks while the output buffer is full.
 // because it may block, it can't be called
 // from interrupts; it's only suitable for use
 // by write().
 void
-uartputc(int c)
+uartwrite(char *s, int n)
 {
+  int i;
+
   acquire(&uart_tx_lock);
 
   if(panicked){
@@ -93,24 +98,49 @@ uartputc(int c)
       ;
   }
 
-  while(1){
+  i = 0;
+  while(i < n){
     if(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
       // buffer is full.
       // wait for uartstart() to open up space in the buffer.
+      uart_tx_waiting = 1;
       sleep(&uart_tx_r, &uart_tx_lock);
-    } else {
-      uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
+      continue;
+    }
+    while(i < n && uart_tx_w < uart_tx_r + UART_TX_BUF_SIZE){
+      uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = s[i++];
       uart_tx_w += 1;
-      uartstart();
-      release(&uart_tx_lock);
-      return;
     }
+    uartstart();
+  }
+  release(&uart_tx_lock);
+}
+
+// add a character to the output buffer, for kernel
+// printf() and to echo characters. it doesn't sleep,
+// so it can be called from interrupts: if the buffer is
+// full, it spins feeding the uart until there is room.
+void
+uartputc(int c)
+{
+  acquire(&uart_tx_lock);
+
+  if(panicked){
+    for(;;)
+      ;
   }
+
+  while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE)
+    uartstart();
+  uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
+  uart_tx_w += 1;
+  uartstart();
+  release(&uart_tx_lock);
 }
 
-// alternate version of uartputc() that doesn't 
-// use interrupts, for use by kernel printf() and
-// to echo characters. it spins waiting for the uart's
+// alternate version of uartputc() that doesn't
+// use interrupts or the output buffer, for use by
+// panic(). it spins waiting for the uart's
 // output register to be empty.
 void
 uartputc_sync(int c)
@@ -130,33 +160,38 @@ uartputc_sync(int c)
   pop_off();
 }
 
-// if the UART is idle, and a character is waiting
-// in the transmit buffer, send it.
+// if the UART is idle, and characters are waiting
+// in the transmit buffer, send them.
 // caller must hold uart_tx_lock.
 // called from both the top- and bottom-half.
 void
 uartstart()
 {
-  while(1){
-    if(uart_tx_w == uart_tx_r){
-      // transmit buffer is empty.
-      return;
-    }
-    
-    if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
-      // the UART transmit holding register is full,
-      // so we cannot give it another byte.
-      // it will interrupt when it's ready for a new byte.
-      return;
-    }
-    
-    int c = uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE];
+  int i;
+
+  if(uart_tx_w == uart_tx_r){
+    // transmit buffer is empty.
+    return;
+  }
+
+  if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
+    // the UART transmit FIFO is not empty yet.
+    // it will interrupt when it's ready for more.
+    return;
+  }
+
+  // the FIFO is empty, so it can take a FIFO's worth.
+  for(i = 0; i < UART_FIFO_SIZE && uart_tx_r != uart_tx_w; i++){
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
     uart_tx_r += 1;
-    
-    // maybe uartputc() is waiting for space in the buffer.
+  }
+
+  // maybe uartwrite() is waiting for space in the buffer.
+  // let the buffer drain to half full first, so that it
+  // wakes up once per half buffer rather than per byte.
+  if(uart_tx_waiting && uart_tx_w - uart_tx_r <= UART_TX_BUF_SIZE/2){
+    uart_tx_waiting = 0;
     wakeup(&uart_tx_r);
-    
-    WriteReg(THR, c);
   }
 }
 
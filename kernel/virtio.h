@@ -44,8 +44,10 @@
 #define VIRTIO_RING_F_EVENT_IDX     29
 
 // this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// must be a power of two, and small enough that the
+// descriptors and avail ring fit in one page and the
+// used ring in the next (see virtio_disk_init()).
+#define NUM 128
 
 // a single descriptor, from the spec.
 struct virtq_desc {
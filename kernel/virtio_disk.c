@@ -5,6 +5,11 @@
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 //
+// requests are asynchronous: virtio_disk_start() queues a batch
+// of bufs and returns, and virtio_disk_intr() marks each buf done
+// and wakes up whoever sleeps on it. bufs with consecutive block
+// numbers in a batch are merged into a single device request.
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -20,6 +25,9 @@
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
+// max bufs merged into one request.
+#define MAXSEG 16
+
 static struct disk {
   // the virtio driver and device mostly communicate through a set of
   // structures in RAM. pages[] allocates that memory. pages[] is a
@@ -59,12 +67,17 @@ static struct disk {
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
-  // indexed by first descriptor index of chain.
+  // b is set for each data descriptor, status
+  // for the first descriptor of each chain.
   struct {
     struct buf *b;
     char status;
   } info[NUM];
 
+  int nfree;     // number of free descriptors.
+  int nreq;      // requests sent to the device.
+  int nblocks;   // blocks moved by those requests.
+
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
@@ -136,6 +149,7 @@ virtio_disk_init(void)
   // all NUM descriptors start out unused.
   for(int i = 0; i < NUM; i++)
     disk.free[i] = 1;
+  disk.nfree = NUM;
 
   // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
 }
@@ -147,6 +161,7 @@ alloc_desc()
   for(int i = 0; i < NUM; i++){
     if(disk.free[i]){
       disk.free[i] = 0;
+      disk.nfree--;
       return i;
     }
   }
@@ -166,6 +181,7 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
+  disk.nfree++;
   wakeup(&disk.free[0]);
 }
 
@@ -184,101 +200,141 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
-static int
-alloc3_desc(int *idx)
+// tell the device about the chain starting at descriptor i.
+// it won't look at it until notify().
+static void
+post(int i)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
-    }
-  }
-  return 0;
+  disk.avail->ring[disk.avail->idx % NUM] = i;
+
+  __sync_synchronize();
+
+  // tell the device another avail ring entry is available.
+  disk.avail->idx += 1; // not % NUM ...
+
+  __sync_synchronize();
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+static void
+notify(void)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
 
-  acquire(&disk.vdisk_lock);
+// post one request for the n bufs in bs, whose block
+// numbers are consecutive. uses n+2 descriptors,
+// which the caller has checked are free.
+static void
+post_req(struct buf **bs, int n, int write)
+{
+  int head, prev, d;
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-
-  // format the three descriptors.
+  // a descriptor for type/reserved/sector, one or more for the
+  // data, and one for a 1-byte status result.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  head = alloc_desc();
+  struct virtio_blk_req *buf0 = &disk.ops[head];
 
   if(write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
     buf0->type = VIRTIO_BLK_T_IN; // read the disk
   buf0->reserved = 0;
-  buf0->sector = sector;
-
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
-
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  buf0->sector = bs[0]->blockno * (BSIZE / 512);
+
+  disk.desc[head].addr = (uint64) buf0;
+  disk.desc[head].len = sizeof(struct virtio_blk_req);
+  disk.desc[head].flags = VRING_DESC_F_NEXT;
+
+  prev = head;
+  for(int i = 0; i < n; i++){
+    d = alloc_desc();
+    disk.desc[prev].next = d;
+    disk.desc[d].addr = (uint64) bs[i]->data;
+    disk.desc[d].len = BSIZE;
+    if(write)
+      disk.desc[d].flags = 0; // device reads b->data
+    else
+      disk.desc[d].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[d].flags |= VRING_DESC_F_NEXT;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+    // record struct buf for virtio_disk_intr().
+    bs[i]->disk = 1;
+    disk.info[d].b = bs[i];
+    prev = d;
+  }
 
-  // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  d = alloc_desc();
+  disk.desc[prev].next = d;
+  disk.info[head].status = 0xff; // device writes 0 on success
+  disk.desc[d].addr = (uint64) &disk.info[head].status;
+  disk.desc[d].len = 1;
+  disk.desc[d].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[d].next = 0;
+
+  disk.nreq++;
+  disk.nblocks += n;
+  post(head);
+}
 
-  __sync_synchronize();
+// start reading (write=0) or writing the n locked bufs in bs,
+// and return without waiting for the disk. the device is
+// notified once for the whole batch. each buf's b->disk stays
+// 1 until its data has been transferred; see virtio_disk_wait().
+void
+virtio_disk_start(struct buf **bs, int n, int write)
+{
+  int i, k, posted;
 
-  // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  acquire(&disk.vdisk_lock);
 
-  __sync_synchronize();
+  posted = 0;
+  for(i = 0; i < n; i += k){
+    // merge a run of consecutive blocks.
+    for(k = 1; i+k < n && k < MAXSEG; k++){
+      if(bs[i+k]->dev != bs[i]->dev ||
+         bs[i+k]->blockno != bs[i+k-1]->blockno + 1)
+        break;
+    }
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+    while(disk.nfree < k + 2){
+      // let the device drain what we've posted so far,
+      // so that it can free descriptors.
+      if(posted){
+        notify();
+        posted = 0;
+      }
+      sleep(&disk.free[0], &disk.vdisk_lock);
+    }
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+    post_req(bs+i, k, write);
+    posted = 1;
   }
+  if(posted)
+    notify();
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  release(&disk.vdisk_lock);
+}
 
+// wait for a buf passed to virtio_disk_start() to be done.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  while(b->disk == 1)
+    sleep(b, &disk.vdisk_lock);
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_start(&b, 1, write);
+  virtio_disk_wait(b);
+}
+
 void
 virtio_disk_intr()
 {
@@ -304,12 +360,27 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    // wake up the owner of each buf in the chain.
+    for(int d = disk.desc[id].next; disk.desc[d].flags & VRING_DESC_F_NEXT; d = disk.desc[d].next){
+      struct buf *b = disk.info[d].b;
+      b->disk = 0;   // disk is done with buf
+      disk.info[d].b = 0;
+      if(b->async)
+        bdone(b);    // no one is waiting; let bio release it.
+      else
+        wakeup(b);
+    }
+    free_chain(id);
 
     disk.used_idx += 1;
   }
 
   release(&disk.vdisk_lock);
 }
+
+// report request merging for /statistics.
+int
+virtio_disk_stats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "virtio: %d requests %d blocks\n", disk.nreq, disk.nblocks);
+}
@@ -5,12 +5,57 @@
 
 char* basename(char*);
 int match(char*, char*);
+void find(char*, char*);
+
+#define NDE 32 // 每次 getdents() 读的目录项个数
+
+// 对目录 fd 中的每一项调用 fn(name, st, arg). 一次 getdents()
+// 读 NDE 项, 连同每一项的 stat, 不用再逐个 open/fstat. 数组放在
+// 堆上, 因为 find() 是递归调用的, 用户栈只有一页.
+int foreachEntry(int fd, void (*fn)(char*, struct stat*, void*), void* arg) {
+    struct dirstat* des;
+    char name[DIRSIZ + 1];
+    int n;
+
+    if ((des = malloc(NDE * sizeof(struct dirstat))) == 0) {
+        return -1;
+    }
+    while ((n = getdents(fd, des, NDE * sizeof(struct dirstat), GD_STAT)) > 0) {
+        for (int i = 0; i < n / sizeof(struct dirstat); ++i) {
+            // name 最长 DIRSIZ 个字符, 不一定以 0 结尾
+            memmove(name, des[i].name, DIRSIZ);
+            name[DIRSIZ] = 0;
+            if (des[i].inum == 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+                continue;
+            fn(name, &des[i].st, arg);
+        }
+    }
+    free(des);
+    return 0;
+}
+
+struct findArg {
+    char* buf;   // 目录的路径, 后面接着 '/'
+    char* p;     // 指向 buf 中 '/' 后面的位置
+    char* pattern;
+};
+
+void findEntry(char* name, struct stat* st, void* arg) {
+    struct findArg* fa = arg;
+
+    strcpy(fa->p, name);
+    if (st->type == T_DIR) {
+        find(fa->buf, fa->pattern);
+    } else if (st->type == T_FILE && match(fa->pattern, name)) {
+        printf("%s\n", fa->buf);
+    }
+}
 
 void find(char* path, char* pattern) {
-    char buf[512], *p;
+    char buf[512];
     int fd;
-    struct dirent de;
     struct stat st;
+    struct findArg fa;
 
     if ((fd = open(path, 0)) < 0) {
         fprintf(2, "find: cannot open %s\n", path);
@@ -36,33 +81,182 @@ void find(char* path, char* pattern) {
                 break;
             }
             strcpy(buf, path);
-            p = buf + strlen(buf);
-            *p++ = '/';
-            while(read(fd, &de, sizeof(de)) == sizeof(de)){
-                if(de.inum == 0 || strcmp(de.name, ".") == 0 || strcmp(de.name, "..") == 0)
-                    continue;
-                int name_len = strlen(de.name);
-                memmove(p, de.name, name_len);
-                p[name_len] = 0;
-                find(buf, pattern);
-            }
+            fa.buf = buf;
+            fa.p = buf + strlen(buf);
+            *fa.p++ = '/';
+            fa.pattern = pattern;
+            foreachEntry(fd, findEntry, &fa);
             break;
     }
     close(fd);
 }
 
+// -P n: 并行查找.
+// 主进程维护待查目录的队列, 把目录分给 n 个 worker 进程. worker
+// 每次只读一个目录, 把找到的文件和子目录通过一个共用的管道发回
+// 主进程, 由主进程打印文件, 把子目录放进队列.
+// 每条消息都是 MSGSIZE 字节, 每次读写正好一条. 内核保证不超过
+// 512 字节的 write() 不会和别的 write() 交错, 所以一条消息
+// 不会被别的 worker 的消息插进来.
+
+#define MAXWORKER 8
+#define MSGSIZE 128
+
+enum { MSG_FILE, MSG_DIR, MSG_DONE };
+
+struct msg {
+    char type;
+    char worker;
+    char path[MSGSIZE - 2];
+};
+
+struct qent {
+    struct qent* next;
+    char path[MSGSIZE - 2];
+};
+
+struct workerArg {
+    struct msg m;  // 要发送的消息, path 里是目录的路径和 '/'
+    char* p;
+    char* pattern;
+    int out;
+};
+
+void workerEntry(char* name, struct stat* st, void* arg) {
+    struct workerArg* wa = arg;
+
+    if (wa->p + strlen(name) + 1 > wa->m.path + sizeof(wa->m.path)) {
+        fprintf(2, "find: path too long\n");
+        return;
+    }
+    strcpy(wa->p, name);
+    if (st->type == T_DIR) {
+        wa->m.type = MSG_DIR;
+    } else if (st->type == T_FILE && match(wa->pattern, name)) {
+        wa->m.type = MSG_FILE;
+    } else {
+        return;
+    }
+    write(wa->out, &wa->m, MSGSIZE);
+}
+
+// worker: 从 in 读目录, 把结果写到 out, 直到 in 被关闭.
+void worker(int id, int in, int out, char* pattern) {
+    struct msg task;
+    struct workerArg wa;
+    int fd, n;
+
+    wa.m.worker = id;
+    wa.pattern = pattern;
+    wa.out = out;
+    while (read(in, &task, MSGSIZE) == MSGSIZE) {
+        strcpy(wa.m.path, task.path);
+        if ((fd = open(task.path, 0)) < 0) {
+            fprintf(2, "find: cannot open %s\n", task.path);
+        } else {
+            n = strlen(wa.m.path);
+            if (n + 1 + DIRSIZ + 1 > sizeof(wa.m.path)) {
+                fprintf(2, "find: path too long\n");
+            } else {
+                wa.p = wa.m.path + n;
+                *wa.p++ = '/';
+                foreachEntry(fd, workerEntry, &wa);
+            }
+            close(fd);
+        }
+        wa.m.type = MSG_DONE;
+        write(out, &wa.m, MSGSIZE);
+    }
+    exit(0);
+}
+
+void pfind(char* path, char* pattern, int nworker) {
+    int task[MAXWORKER], busy[MAXWORKER], res[2], p[2];
+    int i, j, nbusy = 0;
+    struct qent *head = 0, *tail = 0, *q;
+    struct msg m;
+
+    pipe(res);
+    for (i = 0; i < nworker; ++i) {
+        pipe(p);
+        if (fork() == 0) {
+            // 关掉继承来的写端, 否则主进程关闭它们后 worker 读不到 EOF
+            for (j = 0; j < i; ++j) close(task[j]);
+            close(p[1]);
+            close(res[0]);
+            worker(i, p[0], res[1], pattern);
+        }
+        close(p[0]);
+        task[i] = p[1];
+        busy[i] = 0;
+    }
+    close(res[1]);
+
+    m.type = MSG_DIR;
+    strcpy(m.path, path);
+    for (;;) {
+        if (m.type == MSG_DIR) {
+            q = malloc(sizeof(*q));
+            strcpy(q->path, m.path);
+            q->next = 0;
+            if (tail) tail->next = q;
+            else head = q;
+            tail = q;
+        }
+        // 每个 worker 最多只有一个任务, 所以写 task 管道不会阻塞
+        for (i = 0; i < nworker && head; ++i) {
+            if (busy[i]) continue;
+            q = head;
+            if ((head = q->next) == 0) tail = 0;
+            strcpy(m.path, q->path);
+            free(q);
+            write(task[i], &m, MSGSIZE);
+            busy[i] = 1;
+            ++nbusy;
+        }
+        if (nbusy == 0) break;
+
+        if (read(res[0], &m, MSGSIZE) != MSGSIZE) {
+            fprintf(2, "find: lost a worker\n");
+            break;
+        }
+        if (m.type == MSG_FILE) {
+            printf("%s\n", m.path);
+        } else if (m.type == MSG_DONE) {
+            busy[(int)m.worker] = 0;
+            --nbusy;
+        }
+    }
+
+    for (i = 0; i < nworker; ++i) close(task[i]);
+    for (i = 0; i < nworker; ++i) wait(0);
+}
+
+// usage: find [-P n] [path] pattern
 int main(int argc, char* argv[]) {
-    if (argc <= 1) {
-        fprintf(2, "usage: find path pattern\n");
+    int nworker = 0;
+    char* path = ".";
+    struct stat st;
+
+    if (argc > 2 && strcmp(argv[1], "-P") == 0) {
+        nworker = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc <= 1 || argc > 3 || nworker < 0 || nworker > MAXWORKER) {
+        fprintf(2, "usage: find [-P n] [path] pattern\n");
         exit(1);
     }
-
-    if (argc == 2) {
-        find(".", argv[1]);
-        exit(0);
+    if (argc == 3) {
+        path = argv[1];
     }
 
-    find(argv[1], argv[2]);
+    if (nworker > 0 && stat(path, &st) == 0 && st.type == T_DIR
+        && strlen(path) < sizeof(((struct msg*)0)->path)) {
+        pfind(path, argv[argc - 1], nworker);
+    } else {
+        find(path, argv[argc - 1]);
+    }
     exit(0);
 }
 
@@ -2,30 +2,53 @@
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
 #include "user/user.h"
 
 char buf[1024];
 int match(char*, char*);
 
+// Print the lines of the null-terminated text at p that
+// match; returns where the last, unfinished line begins.
+char*
+greplines(char *pattern, char *p)
+{
+  char *q;
+
+  while((q = strchr(p, '\n')) != 0){
+    *q = 0;
+    if(match(pattern, p)){
+      *q = '\n';
+      write(1, p, q+1 - p);
+    }
+    p = q+1;
+  }
+  return p;
+}
+
 void
 grep(char *pattern, int fd)
 {
   int n, m;
-  char *p, *q;
+  char *p;
+  struct stat st;
+
+  // a file can be searched in place: a private mapping
+  // can be written, and the byte after the end is 0.
+  // mmap() maps from the start of the file, so not stdin,
+  // which may have been partly read already.
+  if(fd != 0 && fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size + 1, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0)) != (char*)-1){
+    greplines(pattern, p);
+    munmap(p, st.size + 1);
+    return;
+  }
 
   m = 0;
   while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
     m += n;
     buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
-    }
+    p = greplines(pattern, buf);
     if(m > 0){
       m -= p - buf;
       memmove(buf, p, m);
@@ -0,0 +1,172 @@
+// mallocbench: time malloc/free under allocation-heavy
+// workloads, with the size-class malloc of umalloc.c and
+// with the first-fit allocator it replaced.
+//
+// usage: mallocbench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// The previous allocator, the K&R first-fit free list,
+// kept here for comparison.
+
+typedef long Align;
+
+union header {
+  struct {
+    union header *ptr;
+    uint size;
+  } s;
+  Align x;
+};
+
+typedef union header Header;
+
+static Header base;
+static Header *freep;
+
+static void
+oldfree(void *ap)
+{
+  Header *bp, *p;
+
+  bp = (Header*)ap - 1;
+  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
+    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
+      break;
+  if(bp + bp->s.size == p->s.ptr){
+    bp->s.size += p->s.ptr->s.size;
+    bp->s.ptr = p->s.ptr->s.ptr;
+  } else
+    bp->s.ptr = p->s.ptr;
+  if(p + p->s.size == bp){
+    p->s.size += bp->s.size;
+    p->s.ptr = bp->s.ptr;
+  } else
+    p->s.ptr = bp;
+  freep = p;
+}
+
+static Header*
+morecore(uint nu)
+{
+  char *p;
+  Header *hp;
+
+  if(nu < 4096)
+    nu = 4096;
+  p = sbrk(nu * sizeof(Header));
+  if(p == (char*)-1)
+    return 0;
+  hp = (Header*)p;
+  hp->s.size = nu;
+  oldfree((void*)(hp + 1));
+  return freep;
+}
+
+static void*
+oldmalloc(uint nbytes)
+{
+  Header *p, *prevp;
+  uint nunits;
+
+  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if((prevp = freep) == 0){
+    base.s.ptr = freep = prevp = &base;
+    base.s.size = 0;
+  }
+  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
+    if(p->s.size >= nunits){
+      if(p->s.size == nunits)
+        prevp->s.ptr = p->s.ptr;
+      else {
+        p->s.size -= nunits;
+        p += p->s.size;
+        p->s.size = nunits;
+      }
+      freep = prevp;
+      return (void*)(p + 1);
+    }
+    if(p == freep)
+      if((p = morecore(nunits)) == 0)
+        return 0;
+  }
+}
+
+#define NPTR 256
+
+static void *ptrs[NPTR];
+static uint seed = 1;
+
+static uint
+rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+// like sh parsing a command line: build a few commands'
+// worth of small structs, then free them all.
+static void
+shlike(void *(*alloc)(uint), void (*dealloc)(void*), int rounds)
+{
+  static uint sizes[] = { 168, 40, 24, 168, 24, 40, 168, 24 };
+  int r, i, n;
+
+  for(r = 0; r < rounds; r++){
+    n = 0;
+    for(i = 0; i < 4 * sizeof(sizes)/sizeof(sizes[0]); i++)
+      ptrs[n++] = alloc(sizes[i % (sizeof(sizes)/sizeof(sizes[0]))]);
+    for(i = 0; i < n; i++)
+      dealloc(ptrs[i]);
+  }
+}
+
+// random sizes up to 2000 bytes, freed in random order.
+static void
+mixed(void *(*alloc)(uint), void (*dealloc)(void*), int rounds)
+{
+  int r, i;
+
+  seed = 1;
+  for(r = 0; r < rounds * 16; r++){
+    i = rand() % NPTR;
+    if(ptrs[i]){
+      dealloc(ptrs[i]);
+      ptrs[i] = 0;
+    } else {
+      ptrs[i] = alloc(rand() % 2000 + 1);
+    }
+  }
+  for(i = 0; i < NPTR; i++){
+    if(ptrs[i])
+      dealloc(ptrs[i]);
+    ptrs[i] = 0;
+  }
+}
+
+static void
+run(char *name, void (*fn)(void *(*)(uint), void (*)(void*), int), int rounds)
+{
+  int t0, t1, t2;
+
+  t0 = uptime();
+  fn(oldmalloc, oldfree, rounds);
+  t1 = uptime();
+  fn(malloc, free, rounds);
+  t2 = uptime();
+  printf("%s: first-fit %d ticks, size-class %d ticks\n", name, t1 - t0, t2 - t1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = 20000;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  run("sh-like", shlike, rounds);
+  run("mixed", mixed, rounds);
+  exit(0);
+}
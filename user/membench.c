@@ -0,0 +1,114 @@
+// membench: page zero/copy bandwidth.
+//
+// In user space, times ulib's memset and memmove against the
+// byte-at-a-time loops they replaced. In the kernel, times
+// paths dominated by the kernel's memset and memmove: lazily
+// allocated pages (kalloc fills, the fault handler zeroes)
+// and file reads from the buffer cache (copyout). Run it on
+// kernels before and after a change to compare those.
+//
+// usage: membench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NPAGE 16
+
+static char src[NPAGE * PGSIZE], dst[NPAGE * PGSIZE];
+
+static void
+bytememset(void *d, int c, uint n)
+{
+  volatile char *p = d;
+
+  while(n-- > 0)
+    *p++ = c;
+}
+
+static void
+bytememmove(void *d, const void *s, uint n)
+{
+  volatile char *p = d;
+  const char *q = s;
+
+  while(n-- > 0)
+    *p++ = *q++;
+}
+
+// KB per tick, or the amount if it took no measurable time.
+static void
+report(char *what, int kb, int ticks)
+{
+  if(ticks == 0)
+    printf("%s: %d KB in <1 tick\n", what, kb);
+  else
+    printf("%s: %d KB in %d ticks, %d KB/tick\n", what, kb, ticks, kb / ticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = 200, r, t, i, fd, kb;
+  char *p;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  kb = rounds * sizeof(dst) / 1024;
+
+  t = uptime();
+  for(r = 0; r < rounds; r++)
+    bytememset(dst, r, sizeof(dst));
+  report("user memset, bytes", kb, uptime() - t);
+
+  t = uptime();
+  for(r = 0; r < rounds; r++)
+    memset(dst, r, sizeof(dst));
+  report("user memset", kb, uptime() - t);
+
+  t = uptime();
+  for(r = 0; r < rounds; r++)
+    bytememmove(dst, src, sizeof(dst));
+  report("user memmove, bytes", kb, uptime() - t);
+
+  t = uptime();
+  for(r = 0; r < rounds; r++)
+    memmove(dst, src, sizeof(dst));
+  report("user memmove", kb, uptime() - t);
+
+  // every touched page is kalloc'd, junk-filled and zeroed,
+  // and junk-filled again when it is freed.
+  t = uptime();
+  for(r = 0; r < rounds; r++){
+    if((p = sbrk(NPAGE * PGSIZE)) == (char*)-1){
+      fprintf(2, "membench: sbrk failed\n");
+      exit(1);
+    }
+    for(i = 0; i < NPAGE; i++)
+      p[i * PGSIZE] = 1;
+    sbrk(-NPAGE * PGSIZE);
+  }
+  report("kernel page alloc+zero", kb, uptime() - t);
+
+  // a file small enough to stay in the buffer cache, so
+  // reading it is mostly copyout().
+  unlink("membench.tmp");
+  if((fd = open("membench.tmp", O_CREATE|O_RDWR)) < 0){
+    fprintf(2, "membench: cannot create membench.tmp\n");
+    exit(1);
+  }
+  write(fd, src, 4 * PGSIZE);
+  t = uptime();
+  for(r = 0; r < rounds * NPAGE / 4; r++){
+    close(fd);
+    fd = open("membench.tmp", O_RDONLY);
+    read(fd, dst, 4 * PGSIZE);
+  }
+  report("kernel copyout", kb, uptime() - t);
+  close(fd);
+  unlink("membench.tmp");
+
+  exit(0);
+}
@@ -0,0 +1,26 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// nice level command [args]
+// run command at a priority level from 0 (highest,
+// the default) to NPRIO-1.
+int
+main(int argc, char *argv[])
+{
+  int level;
+
+  if(argc < 3 || argv[1][0] < '0' || argv[1][0] > '9'){
+    fprintf(2, "usage: nice level command [args]\n");
+    exit(1);
+  }
+  level = atoi(argv[1]);
+  if(setpriority(getpid(), level) < 0){
+    fprintf(2, "nice: bad level %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv+2);
+  fprintf(2, "nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -2,56 +2,132 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 
+// 每次 read/write 的整数个数 (512 字节)
+#define BATCH 128
+
 void helper();
 void changefdAndCloseP(int, int *);
+int readBatch(int *);
+void writeBatch(int, int *, int);
+
+int quiet;        // -q: 只打印素数个数和耗时
+int perStage = 1; // 每个筛选进程留下的素数个数
 
+// usage: primes [-q] [max [perstage]]
+// 不带参数时和原来一样, 打印 35 以内的素数, 每个进程筛一个素数.
+// max 较大时每个进程要筛多个素数, 否则进程数会超过 NPROC.
 int main(int argc, char *argv[]) {
-    int p[2];
-    pipe(p);
+    int p[2], max = 35, nums[BATCH], n, count, start;
 
+    if (argc > 1 && strcmp(argv[1], "-q") == 0) {
+        quiet = 1;
+        argc--;
+        argv++;
+    }
+    if (argc > 1) {
+        max = atoi(argv[1]);
+        perStage = max / 256 + 1;
+    }
+    if (argc > 2) {
+        perStage = atoi(argv[2]);
+    }
+    if (max < 2 || perStage < 1) {
+        fprintf(2, "usage: primes [-q] [max [perstage]]\n");
+        exit(1);
+    }
+
+    start = uptime();
+    pipe(p);
     if (fork() == 0) {
         changefdAndCloseP(0, p);
         helper();
     }
+    close(p[0]);
 
-    changefdAndCloseP(1, p);
-    close(0);
-
-    for (int i = 2; i <= 35; ++i) {
-        write(1, &i, 4);
+    n = 0;
+    for (int i = 2; i <= max; ++i) {
+        nums[n++] = i;
+        if (n == BATCH) {
+            writeBatch(p[1], nums, n);
+            n = 0;
+        }
     }
+    writeBatch(p[1], nums, n);
+    close(p[1]);
 
-    close(1);
-    wait(0);
+    wait(&count);
+    if (argc > 1 || quiet) {
+        printf("%d primes up to %d, %d per process, %d ticks\n",
+               count, max, perStage, uptime() - start);
+    }
     exit(0);
 }
 
+// 从上一级读入一批数, 留下前 perStage 个素数, 把剩下的数中
+// 不能被它们整除的成批传给下一级.
+// 退出状态是这一级及之后各级找到的素数个数.
 void helper() {
-    int ori_num, num;
-    if (read(0, &ori_num, 4) == 0) {
-        exit(0);
-    }
+    int in[BATCH], out[BATCH], *primes;
+    int n, nout = 0, nprime = 0, next = -1, count = 0;
 
-    printf("prime %d\n", ori_num);
+    primes = malloc(perStage * sizeof(int));
+    while ((n = readBatch(in)) > 0) {
+        for (int i = 0; i < n; ++i) {
+            int num = in[i], j;
 
-    int p[2];
-    pipe(p);
-    if (fork() == 0) {
-        changefdAndCloseP(0, p);
-        helper();
-    }
+            for (j = 0; j < nprime; ++j) {
+                if (num % primes[j] == 0) break;
+            }
+            if (j < nprime) continue;
 
-    changefdAndCloseP(1, p);
+            // 比 num 小的素数都在这一级或上一级, 所以 num 是素数
+            if (nprime < perStage) {
+                primes[nprime++] = num;
+                if (!quiet) printf("prime %d\n", num);
+                continue;
+            }
 
-    while (read(0, &num, 4) == 4) {
-        if (num % ori_num == 0) continue;
+            if (next < 0) {
+                int p[2];
+                pipe(p);
+                if (fork() == 0) {
+                    free(primes);
+                    changefdAndCloseP(0, p);
+                    helper();
+                }
+                close(p[0]);
+                next = p[1];
+            }
+            out[nout++] = num;
+            if (nout == BATCH) {
+                writeBatch(next, out, nout);
+                nout = 0;
+            }
+        }
+    }
 
-        write(1, &num, 4);
+    if (next >= 0) {
+        writeBatch(next, out, nout);
+        close(next);
+        wait(&count);
     }
+    exit(nprime + count);
+}
 
-    close(1);
-    wait(0);
-    exit(0);
+// 读一批整数, 返回个数, 0 表示上一级已经写完.
+// 管道可能只给出半个整数, 所以要读到整数边界为止.
+int readBatch(int *buf) {
+    int n = 0, r;
+
+    do {
+        if ((r = read(0, (char *)buf + n, BATCH * sizeof(int) - n)) <= 0) break;
+        n += r;
+    } while (n % sizeof(int) != 0);
+    return n / sizeof(int);
+}
+
+void writeBatch(int fd, int *buf, int n) {
+    if (n > 0) write(fd, buf, n * sizeof(int));
 }
 
 void changefdAndCloseP(int fd, int *p) {
@@ -59,4 +135,4 @@ void changefdAndCloseP(int fd, int *p) {
     dup(p[fd]);
     close(p[0]);
     close(p[1]);
-}
\ No newline at end of file
+}
@@ -6,14 +6,105 @@
 
 static char digits[] = "0123456789ABCDEF";
 
+// Output is collected in a buffer and handed to write()
+// in one piece instead of a character at a time.
+// fds below NOBUF keep their buffer between calls, in the
+// mode setvbuf() chose, or by default: unbuffered for fd 2,
+// line buffered for devices such as the console, and fully
+// buffered for files and pipes. Other fds use a buffer on
+// the stack that is written at the end of each call.
+// ulib.c's fork, exit, close and exec call flushhook so
+// that nothing is lost or printed twice.
+
+#define NOBUF 3
+#define OBUFSZ 512
+
+struct outbuf {
+  int fd;
+  int mode;     // 0 until the first use of fd
+  int n;
+  int size;
+  char *buf;
+};
+
+static char obufmem[NOBUF][OBUFSZ];
+static struct outbuf obuf[NOBUF];
+
+static void
+flush(struct outbuf *o)
+{
+  if(o->n > 0)
+    write(o->fd, o->buf, o->n);
+  o->n = 0;
+}
+
 static void
-putc(int fd, char c)
+putc(struct outbuf *o, char c)
 {
-  write(fd, &c, 1);
+  o->buf[o->n++] = c;
+  if(o->n == o->size || (c == '\n' && o->mode == _IOLBF))
+    flush(o);
 }
 
+// Flush fd, or every fd if fd is -1.
+int
+fflush(int fd)
+{
+  int i;
+
+  for(i = 0; i < NOBUF; i++){
+    if(fd == -1 || fd == i){
+      obuf[i].fd = i;
+      flush(&obuf[i]);
+    }
+  }
+  return 0;
+}
+
+// fd is about to be closed, forked or exec'd (-1):
+// flush it, and forget its mode if it is closed,
+// since a later open() or dup() may reuse it.
 static void
-printint(int fd, int xx, int base, int sgn)
+closehook(int fd)
+{
+  fflush(fd);
+  if(fd >= 0 && fd < NOBUF)
+    obuf[fd].mode = 0;
+}
+
+void
+setvbuf(int fd, int mode)
+{
+  if(fd < 0 || fd >= NOBUF)
+    return;
+  fflush(fd);
+  obuf[fd].mode = mode;
+}
+
+static struct outbuf*
+getobuf(int fd)
+{
+  struct outbuf *o;
+  struct stat st;
+
+  o = &obuf[fd];
+  o->fd = fd;
+  o->buf = obufmem[fd];
+  o->size = OBUFSZ;
+  if(o->mode == 0){
+    if(fd == 2)
+      o->mode = _IONBF;
+    else if(fstat(fd, &st) == 0 && st.type == T_DEVICE)
+      o->mode = _IOLBF;
+    else
+      o->mode = _IOFBF;
+  }
+  flushhook = closehook;
+  return o;
+}
+
+static void
+printint(struct outbuf *o, int xx, int base, int sgn)
 {
   char buf[16];
   int i, neg;
@@ -35,16 +126,16 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(o, buf[i]);
 }
 
 static void
-printptr(int fd, uint64 x) {
+printptr(struct outbuf *o, uint64 x) {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(o, '0');
+  putc(o, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(o, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the given fd. Only understands %d, %x, %p, %s.
@@ -53,6 +144,19 @@ vprintf(int fd, const char *fmt, va_list ap)
 {
   char *s;
   int c, i, state;
+  struct outbuf *o, tmp;
+  char tmpbuf[128];
+
+  if(fd >= 0 && fd < NOBUF){
+    o = getobuf(fd);
+  } else {
+    tmp.fd = fd;
+    tmp.mode = _IONBF;
+    tmp.n = 0;
+    tmp.size = sizeof(tmpbuf);
+    tmp.buf = tmpbuf;
+    o = &tmp;
+  }
 
   state = 0;
   for(i = 0; fmt[i]; i++){
@@ -61,37 +165,39 @@ vprintf(int fd, const char *fmt, va_list ap)
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        putc(o, c);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, va_arg(ap, int), 10, 1);
+        printint(o, va_arg(ap, int), 10, 1);
       } else if(c == 'l') {
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(o, va_arg(ap, uint64), 10, 0);
       } else if(c == 'x') {
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(o, va_arg(ap, int), 16, 0);
       } else if(c == 'p') {
-        printptr(fd, va_arg(ap, uint64));
+        printptr(o, va_arg(ap, uint64));
       } else if(c == 's'){
         s = va_arg(ap, char*);
         if(s == 0)
           s = "(null)";
         while(*s != 0){
-          putc(fd, *s);
+          putc(o, *s);
           s++;
         }
       } else if(c == 'c'){
-        putc(fd, va_arg(ap, uint));
+        putc(o, va_arg(ap, uint));
       } else if(c == '%'){
-        putc(fd, c);
+        putc(o, c);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        putc(o, '%');
+        putc(o, c);
       }
       state = 0;
     }
   }
+  if(o->mode == _IONBF)
+    flush(o);
 }
 
 void
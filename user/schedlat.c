@@ -0,0 +1,84 @@
+// schedlat: wakeup-to-run latency.
+//
+// Two processes pass a byte back and forth over a pair of
+// pipes, so each round trip is two wakeups of a sleeping
+// process. Optional CPU-bound children keep the other CPUs
+// busy, so the wakeups compete with runnable processes.
+// Compare the time per round trip on kernels before and
+// after a scheduler change; /statistics shows
+// how the scheduler placed the processes.
+//
+// usage: schedlat [rounds [hogs]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NHOG 8
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = 10000, nhog = 0, i, pid;
+  uint64 t;
+  int hogs[NHOG], ping[2], pong[2];
+  char c = 0;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(argc > 2)
+    nhog = atoi(argv[2]);
+  if(rounds < 1 || nhog < 0 || nhog > NHOG){
+    fprintf(2, "usage: schedlat [rounds [hogs]]\n");
+    exit(1);
+  }
+
+  for(i = 0; i < nhog; i++){
+    if((hogs[i] = fork()) < 0){
+      fprintf(2, "schedlat: fork failed\n");
+      exit(1);
+    }
+    if(hogs[i] == 0){
+      for(;;)
+        ;
+    }
+  }
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    fprintf(2, "schedlat: pipe failed\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    fprintf(2, "schedlat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  t = nanotime();
+  for(i = 0; i < rounds; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      fprintf(2, "schedlat: round trip %d failed\n", i);
+      exit(1);
+    }
+  }
+  t = nanotime() - t;
+  close(ping[1]);
+  wait(0);
+
+  for(i = 0; i < nhog; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+
+  printf("%d round trips with %d hogs: %d ms, %d us each\n",
+         rounds, nhog, (int)(t / 1000000), (int)(t / 1000 / rounds));
+  exit(0);
+}
@@ -0,0 +1,22 @@
+// stats: print the kernel's /statistics report.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  char buf[512];
+  int fd, n;
+
+  if((fd = open("/statistics", O_RDONLY)) < 0){
+    fprintf(2, "stats: cannot open /statistics\n");
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    write(1, buf, n);
+  close(fd);
+  exit(0);
+}
@@ -57,14 +57,37 @@ strlen(const char *s)
   return n;
 }
 
+// memset, memmove and memcpy move 8 bytes at a time once
+// dst (and src) are 8-byte aligned, and single bytes for the
+// unaligned head and the tail, or when dst and src are not
+// aligned alike.
+
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = dst;
+  uint64 w, *wd;
+
+  for(; n > 0 && ((uint64)d & 7); n--)
+    *d++ = c;
+  if(n >= 8){
+    w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    wd = (uint64*)d;
+    for(; n >= 32; n -= 32, wd += 4){
+      wd[0] = w;
+      wd[1] = w;
+      wd[2] = w;
+      wd[3] = w;
+    }
+    for(; n >= 8; n -= 8)
+      *wd++ = w;
+    d = (uchar*)wd;
   }
+  for(; n > 0; n--)
+    *d++ = c;
   return dst;
 }
 
@@ -123,17 +146,55 @@ atoi(const char *s)
 void*
 memmove(void *vdst, const void *vsrc, int n)
 {
-  char *dst;
-  const char *src;
+  uchar *dst;
+  const uchar *src;
+  uint64 *wd;
+  const uint64 *ws;
+  int aligned;
 
   dst = vdst;
   src = vsrc;
+  aligned = (((uint64)dst ^ (uint64)src) & 7) == 0;
   if (src > dst) {
+    if (aligned) {
+      for (; n > 0 && ((uint64)dst & 7); n--)
+        *dst++ = *src++;
+      wd = (uint64*)dst;
+      ws = (const uint64*)src;
+      for (; n >= 32; n -= 32, wd += 4, ws += 4) {
+        wd[0] = ws[0];
+        wd[1] = ws[1];
+        wd[2] = ws[2];
+        wd[3] = ws[3];
+      }
+      for (; n >= 8; n -= 8)
+        *wd++ = *ws++;
+      dst = (uchar*)wd;
+      src = (const uchar*)ws;
+    }
     while(n-- > 0)
       *dst++ = *src++;
   } else {
     dst += n;
     src += n;
+    if (aligned) {
+      for (; n > 0 && ((uint64)dst & 7); n--)
+        *--dst = *--src;
+      wd = (uint64*)dst;
+      ws = (const uint64*)src;
+      for (; n >= 32; n -= 32) {
+        wd -= 4;
+        ws -= 4;
+        wd[3] = ws[3];
+        wd[2] = ws[2];
+        wd[1] = ws[1];
+        wd[0] = ws[0];
+      }
+      for (; n >= 8; n -= 8)
+        *--wd = *--ws;
+      dst = (uchar*)wd;
+      src = (const uchar*)ws;
+    }
     while(n-- > 0)
       *--dst = *--src;
   }
@@ -159,3 +220,39 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// set by printf.c once it holds buffered output.
+// called with an fd to flush it, or -1 to flush all.
+void (*flushhook)(int);
+
+int
+fork(void)
+{
+  if(flushhook)
+    flushhook(-1);   // or the child would print it again.
+  return _fork();
+}
+
+int
+exit(int status)
+{
+  if(flushhook)
+    flushhook(-1);
+  _exit(status);
+}
+
+int
+close(int fd)
+{
+  if(flushhook)
+    flushhook(fd);
+  return _close(fd);
+}
+
+int
+exec(char *path, char **argv)
+{
+  if(flushhook)
+    flushhook(-1);
+  return _exec(path, argv);
+}
@@ -3,7 +3,14 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
+// Small requests are served from segregated free lists,
+// one per size class: malloc pops a block off its class's
+// list and free pushes it back, with no search and no
+// coalescing. A class's list is refilled by carving up a
+// chunk taken from the general allocator below, which also
+// serves large requests.
+//
+// The general allocator is by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
 
 typedef long Align;
@@ -21,8 +28,21 @@ typedef union header Header;
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+// every block starts with a Header. s.size is the size of a
+// general block in Headers, or SMALL|class for a small block,
+// whose s.ptr links it into its class's free list.
+#define SMALL 0x80000000
+#define CHUNK 4096     // bytes carved at once into small blocks
+
+static uint classsize[] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+};
+#define NCLASS (sizeof(classsize)/sizeof(classsize[0]))
+
+static Header *smallfree[NCLASS];
+
+static void
+kr_free(void *ap)
 {
   Header *bp, *p;
 
@@ -56,12 +76,12 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  kr_free((void*)(hp + 1));
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+static void*
+kr_malloc(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
@@ -88,3 +108,92 @@ malloc(uint nbytes)
         return 0;
   }
 }
+
+// Carve a chunk into free blocks of class c.
+static int
+refill(int c)
+{
+  char *p;
+  uint i, n, bsize;
+  Header *h;
+
+  bsize = sizeof(Header) + classsize[c];
+  n = CHUNK / bsize;
+  if((p = kr_malloc(n * bsize)) == 0)
+    return -1;
+  for(i = 0; i < n; i++){
+    h = (Header*)(p + i*bsize);
+    h->s.size = SMALL | c;
+    h->s.ptr = smallfree[c];
+    smallfree[c] = h;
+  }
+  return 0;
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *h;
+  int c;
+
+  for(c = 0; c < NCLASS; c++){
+    if(nbytes <= classsize[c])
+      break;
+  }
+  if(c == NCLASS)
+    return kr_malloc(nbytes);
+
+  if(smallfree[c] == 0 && refill(c) < 0)
+    return 0;
+  h = smallfree[c];
+  smallfree[c] = h->s.ptr;
+  return (void*)(h + 1);
+}
+
+void
+free(void *ap)
+{
+  Header *h;
+  int c;
+
+  if(ap == 0)
+    return;
+  h = (Header*)ap - 1;
+  if((h->s.size & SMALL) == 0){
+    kr_free(ap);
+    return;
+  }
+  c = h->s.size & ~SMALL;
+  h->s.ptr = smallfree[c];
+  smallfree[c] = h;
+}
+
+// Bytes that the block at ap can hold.
+static uint
+capacity(void *ap)
+{
+  Header *h;
+
+  h = (Header*)ap - 1;
+  if(h->s.size & SMALL)
+    return classsize[h->s.size & ~SMALL];
+  return (h->s.size - 1) * sizeof(Header);
+}
+
+void*
+realloc(void *ap, uint nbytes)
+{
+  void *np;
+  uint n;
+
+  if(ap == 0)
+    return malloc(nbytes);
+  n = capacity(ap);
+  if(nbytes <= n)
+    return ap;
+  if((np = malloc(nbytes)) == 0)
+    return 0;
+  memmove(np, ap, n);
+  free(ap);
+  return np;
+}
@@ -23,6 +23,20 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int getdents(int, void*, int, int);
+int setpriority(int, int);
+int nanosleep(uint64);
+uint64 nanotime(void);
+int pipesize(int, int);
+int splice(int, int, int);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+// the raw system calls behind fork, exit, close and exec,
+// which ulib.c wraps to flush printf's buffers first.
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
+int _close(int);
+int _exec(char*, char**);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -34,11 +48,20 @@ int strcmp(const char*, const char*);
 int strncmp(const char*, const char*, uint);
 void fprintf(int, const char*, ...);
 void printf(const char*, ...);
+int fflush(int);
+void setvbuf(int, int);
+extern void (*flushhook)(int);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
+void* realloc(void*, uint);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+// buffering modes for setvbuf().
+#define _IONBF 1   // write at the end of each printf call
+#define _IOLBF 2   // write at each newline
+#define _IOFBF 3   // write when the buffer fills
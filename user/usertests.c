@@ -1553,6 +1553,566 @@ bigdir(char *s)
   }
 }
 
+// enough names to make the kernel grow, shrink and
+// rebuild a directory's hash index, checking lookups
+// for present and removed names along the way.
+void
+dirindex(char *s)
+{
+  enum { N = 400 };
+  int i, fd, pass;
+  char name[10];
+
+  if(mkdir("di") != 0){
+    printf("%s: mkdir di failed\n", s);
+    exit(1);
+  }
+  fd = open("di/f", O_CREATE);
+  if(fd < 0){
+    printf("%s: create di/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  name[0] = 'd';
+  name[1] = 'i';
+  name[2] = '/';
+  name[3] = 'x';
+  name[6] = '\0';
+  for(pass = 0; pass < 4; pass++){
+    for(i = 0; i < N; i++){
+      name[4] = '0' + (i / 64);
+      name[5] = '0' + (i % 64);
+      if(pass == 0 || (pass == 2 && i % 2 == 0)){
+        // add all names, then put back the even ones.
+        if(link("di/f", name) != 0){
+          printf("%s: link(di/f, %s) failed\n", s, name);
+          exit(1);
+        }
+      } else if(pass == 1 && i % 2 == 0){
+        // remove the even names; the odd ones must still be found.
+        if(unlink(name) != 0){
+          printf("%s: unlink %s failed\n", s, name);
+          exit(1);
+        }
+      } else if(pass == 3){
+        if(unlink(name) != 0){
+          printf("%s: unlink %s failed\n", s, name);
+          exit(1);
+        }
+        continue;
+      }
+      fd = open(name, O_RDONLY);
+      if((fd >= 0) != (pass != 1 || i % 2 == 1)){
+        printf("%s: open %s returned %d\n", s, name, fd);
+        exit(1);
+      }
+      if(fd >= 0)
+        close(fd);
+    }
+  }
+  if(unlink("di/f") != 0 || unlink("di") != 0){
+    printf("%s: cleanup of di failed\n", s);
+    exit(1);
+  }
+}
+
+// the directory name cache must notice names that
+// come and go, and directories that are freed and
+// have their inode reused.
+void
+dcache(char *s)
+{
+  int i, fd;
+
+  for(i = 0; i < 10; i++){
+    if(open("dc", O_RDONLY) >= 0){
+      printf("%s: open dc succeeded before mkdir\n", s);
+      exit(1);
+    }
+    if(mkdir("dc") != 0){
+      printf("%s: mkdir dc failed\n", s);
+      exit(1);
+    }
+    if(open("dc/x", O_RDONLY) >= 0){
+      printf("%s: open dc/x succeeded before create\n", s);
+      exit(1);
+    }
+    fd = open("dc/x", O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf("%s: create dc/x failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if((fd = open("dc/x", O_RDONLY)) < 0){
+      printf("%s: open dc/x failed after create\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(link("dc/x", "dc/y") != 0 || (fd = open("dc/y", O_RDONLY)) < 0){
+      printf("%s: link dc/y failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(unlink("dc/x") != 0 || unlink("dc/y") != 0){
+      printf("%s: unlink failed\n", s);
+      exit(1);
+    }
+    if(open("dc/x", O_RDONLY) >= 0 || open("dc/y", O_RDONLY) >= 0){
+      printf("%s: open succeeded after unlink\n", s);
+      exit(1);
+    }
+    if(unlink("dc") != 0){
+      printf("%s: unlink dc failed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// getdents() returns every in-use entry once, with
+// the right stat, in buffers too small for all of them.
+void
+getdentstest(char *s)
+{
+  enum { N = 20 };
+  struct dirstat ds[3];
+  struct dirent de[3];
+  char name[10];
+  int fd, i, n, seen, pass;
+
+  if(mkdir("gd") != 0){
+    printf("%s: mkdir gd failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    name[0] = 'g'; name[1] = 'd'; name[2] = '/';
+    name[3] = 'a' + i; name[4] = '\0';
+    fd = open(name, O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    write(fd, name, i);
+    close(fd);
+    if(i % 2 == 1 && unlink(name) != 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+
+  for(pass = 0; pass < 2; pass++){
+    fd = open("gd", O_RDONLY);
+    seen = 0;
+    for(;;){
+      if(pass == 0)
+        n = getdents(fd, ds, sizeof(ds), GD_STAT) / sizeof(ds[0]);
+      else
+        n = getdents(fd, de, sizeof(de), 0) / sizeof(de[0]);
+      if(n <= 0)
+        break;
+      for(i = 0; i < n; i++){
+        if(pass == 1 && de[i].inum == 0){
+          printf("%s: getdents returned an empty entry\n", s);
+          exit(1);
+        }
+        if(pass == 1 || ds[i].name[0] == '.')
+          continue;
+        if(ds[i].st.type != T_FILE || ds[i].st.size != ds[i].name[0] - 'a' ||
+           ds[i].st.ino != ds[i].inum || (ds[i].name[0] - 'a') % 2 != 0){
+          printf("%s: bad entry %c\n", s, ds[i].name[0]);
+          exit(1);
+        }
+      }
+      seen += n;
+    }
+    close(fd);
+    if(seen != N/2 + 2){
+      printf("%s: getdents saw %d entries\n", s, seen);
+      exit(1);
+    }
+  }
+
+  fd = open("gd/a", O_RDONLY);
+  if(getdents(fd, ds, sizeof(ds), GD_STAT) != -1){
+    printf("%s: getdents on a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < N; i += 2){
+    name[3] = 'a' + i;
+    unlink(name);
+  }
+  if(unlink("gd") != 0){
+    printf("%s: unlink gd failed\n", s);
+    exit(1);
+  }
+}
+
+// setpriority() checks its arguments, returns the old
+// setting, and a fork child inherits it.
+void
+prioritytest(char *s)
+{
+  int pid, fds[2];
+  char c;
+
+  if(setpriority(getpid(), NPRIO) != -1 || setpriority(getpid(), -1) != -1){
+    printf("%s: setpriority accepted a bad level\n", s);
+    exit(1);
+  }
+  if(setpriority(-1, 0) != -1){
+    printf("%s: setpriority accepted a bad pid\n", s);
+    exit(1);
+  }
+  if(setpriority(getpid(), NPRIO-1) != 0){
+    printf("%s: setpriority did not return 0\n", s);
+    exit(1);
+  }
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    read(fds[0], &c, 1);
+    exit(0);
+  }
+  close(fds[0]);
+  if(setpriority(pid, 0) != NPRIO-1){
+    printf("%s: child did not inherit its priority\n", s);
+    exit(1);
+  }
+  write(fds[1], "x", 1);
+  close(fds[1]);
+  wait(0);
+
+  if(setpriority(getpid(), 0) != NPRIO-1){
+    printf("%s: setpriority lost the setting\n", s);
+    exit(1);
+  }
+}
+
+// nanosleep() sleeps at least as long as asked, with less
+// than a tick's granularity, and uptime() keeps counting
+// while every CPU may be idle.
+void
+nanosleeptest(char *s)
+{
+  uint64 t0, t1;
+  int i, u0;
+
+  for(i = 0; i < 10; i++){
+    t0 = nanotime();
+    if(nanosleep(5000000) != 0){
+      printf("%s: nanosleep failed\n", s);
+      exit(1);
+    }
+    t1 = nanotime();
+    if(t1 - t0 < 5000000){
+      printf("%s: nanosleep(5ms) took %d ns\n", s, (int)(t1 - t0));
+      exit(1);
+    }
+  }
+
+  t0 = nanotime();
+  for(i = 0; i < 20; i++)
+    nanosleep(1000000);
+  t1 = nanotime();
+  if(t1 - t0 >= 1000000000){
+    // a tick is 100ms, so a tick-granular sleep would take 2s.
+    printf("%s: 20 1ms sleeps took %d ms\n", s, (int)((t1 - t0) / 1000000));
+    exit(1);
+  }
+
+  u0 = uptime();
+  sleep(3);
+  if(uptime() - u0 < 3){
+    printf("%s: uptime went from %d to %d over sleep(3)\n", s, u0, uptime());
+    exit(1);
+  }
+}
+
+// pipesize() grows a pipe's buffer, keeping its contents,
+// and refuses sizes the contents don't fit in.
+void
+pipesizetest(char *s)
+{
+  enum { N = 12000 };
+  int fds[2], i, n, fd;
+  char *buf;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(pipesize(fds[0], 0) != 4096){
+    printf("%s: default pipe size %d\n", s, pipesize(fds[0], 0));
+    exit(1);
+  }
+  buf = malloc(N);
+  for(i = 0; i < N; i++)
+    buf[i] = i % 251;
+  if(write(fds[1], buf, 1000) != 1000){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(pipesize(fds[1], 10000) != 16384){
+    printf("%s: pipesize(10000) failed\n", s);
+    exit(1);
+  }
+  // the rest fits without a reader.
+  if(write(fds[1], buf + 1000, N - 1000) != N - 1000){
+    printf("%s: write to grown pipe failed\n", s);
+    exit(1);
+  }
+  if(pipesize(fds[1], 4096) != -1 || pipesize(fds[1], 1 << 30) != -1){
+    printf("%s: pipesize accepted a bad size\n", s);
+    exit(1);
+  }
+  memset(buf, 0, N);
+  for(i = 0; i < N; i += n){
+    if((n = read(fds[0], buf + i, N - i)) <= 0){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i++){
+    if(buf[i] != (char)(i % 251)){
+      printf("%s: wrong byte %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  free(buf);
+
+  fd = open("README", O_RDONLY);
+  if(fd >= 0 && pipesize(fd, 0) != -1){
+    printf("%s: pipesize on a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+}
+
+// splice() moves a file's data into a pipe and a pipe's
+// data into a file, and refuses two files.
+void
+splicetest(char *s)
+{
+  enum { N = 3000 };
+  int fds[2], fd, i, n, tot;
+  char *buf;
+
+  buf = malloc(N);
+  for(i = 0; i < N; i++)
+    buf[i] = i % 253;
+  unlink("splice1");
+  unlink("splice2");
+  fd = open("splice1", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, N) != N){
+    printf("%s: create splice1 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  fd = open("splice1", O_RDONLY);
+  if((n = splice(fd, fds[1], N + 100)) != N){
+    printf("%s: splice from file moved %d bytes\n", s, n);
+    exit(1);
+  }
+  if(splice(fd, fds[1], 100) != 0){
+    printf("%s: splice at end of file moved data\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fds[1]);
+
+  fd = open("splice2", O_CREATE|O_RDWR);
+  for(tot = 0; (n = splice(fds[0], fd, 1000)) > 0; tot += n)
+    ;
+  if(n != 0 || tot != N){
+    printf("%s: splice to file moved %d bytes, then %d\n", s, tot, n);
+    exit(1);
+  }
+  close(fds[0]);
+  if(splice(fd, fd, 10) != -1){
+    printf("%s: splice between files succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  memset(buf, 0, N);
+  fd = open("splice2", O_RDONLY);
+  if(read(fd, buf, N) != N){
+    printf("%s: read splice2 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < N; i++){
+    if(buf[i] != (char)(i % 253)){
+      printf("%s: wrong byte %d\n", s, i);
+      exit(1);
+    }
+  }
+  free(buf);
+  unlink("splice1");
+  unlink("splice2");
+}
+
+// mmap() a file shared and private, and anonymous memory:
+// pages are filled in lazily, shared writes reach the file
+// on munmap(), private ones don't, and a fork child sees
+// its parent's mappings.
+void
+mmaptest(char *s)
+{
+  enum { N = 10000 };  // three pages
+  int fd, i, pid, xstatus;
+  char *buf, *p, *q;
+
+  buf = malloc(N);
+  for(i = 0; i < N; i++)
+    buf[i] = 'a' + i % 26;
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, N) != N){
+    printf("%s: create mmapfile failed\n", s);
+    exit(1);
+  }
+
+  // bad arguments.
+  if(mmap(0, N, PROT_READ, 0, fd, 0) != (void*)-1 ||
+     mmap(0, N, PROT_READ, MAP_SHARED, fd, 100) != (void*)-1 ||
+     mmap(0, N, PROT_READ, MAP_SHARED|MAP_ANON, -1, 0) != (void*)-1){
+    printf("%s: mmap accepted bad arguments\n", s);
+    exit(1);
+  }
+
+  p = mmap(0, N, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, N, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1 || q == (char*)-1 || p == q){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < N; i++){
+    if(p[i] != buf[i] || q[i] != buf[i]){
+      printf("%s: wrong byte %d in mapping\n", s, i);
+      exit(1);
+    }
+  }
+  // past the end of the file, the last page is zeroed.
+  if(p[N] != 0){
+    printf("%s: mapping past end of file not zero\n", s);
+    exit(1);
+  }
+
+  p[0] = 'X';
+  q[1] = 'Y';
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(p[0] != 'X' || q[1] != 'Y')
+      exit(1);
+    q[2] = 'Z';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || q[2] == 'Z'){
+    printf("%s: fork child saw wrong mappings\n", s);
+    exit(1);
+  }
+  p[N-1] = 'W';
+  // unmapping the middle page splits the mapping.
+  if(munmap(p + PGSIZE, PGSIZE) != 0 || munmap(p, PGSIZE) != 0 ||
+     munmap(q, N) != 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  if(munmap(p + PGSIZE, PGSIZE) == 0){
+    printf("%s: munmap of an unmapped page succeeded\n", s);
+    exit(1);
+  }
+
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, N) != N || buf[0] != 'X' || buf[1] != 'b' ||
+     buf[N-1] == 'W'){
+    printf("%s: file has wrong contents after munmap\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(munmap(p + 2*PGSIZE, PGSIZE) != 0){
+    printf("%s: munmap of last page failed\n", s);
+    exit(1);
+  }
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, N) != N || buf[N-1] != 'W'){
+    printf("%s: last page not written back\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // exit() writes back what is still mapped.
+  pid = fork();
+  if(pid == 0){
+    fd = open("mmapfile", O_RDWR);
+    p = mmap(0, N, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == (char*)-1)
+      exit(1);
+    p[2] = 'E';
+    exit(0);
+  }
+  wait(&xstatus);
+  fd = open("mmapfile", O_RDONLY);
+  if(xstatus != 0 || read(fd, buf, N) != N || buf[2] != 'E'){
+    printf("%s: exit did not write back a mapping\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // anonymous memory.
+  p = mmap(0, 1024*1024, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+  if(p == (char*)-1){
+    printf("%s: anonymous mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 1024*1024; i += PGSIZE){
+    if(p[i] != 0){
+      printf("%s: anonymous page not zero\n", s);
+      exit(1);
+    }
+    p[i] = i / PGSIZE;
+  }
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, p + 5, 10) != 10 || p[5] != 'X'){
+    printf("%s: read into anonymous mapping failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(munmap(p, 1024*1024) != 0){
+    printf("%s: munmap anonymous failed\n", s);
+    exit(1);
+  }
+
+  free(buf);
+  unlink("mmapfile");
+}
+
 void
 subdir(char *s)
 {
@@ -2080,6 +2640,85 @@ forktest(char *s)
   }
 }
 
+// fork a process with more memory than the kernel could
+// copy eagerly; copy-on-write must share it instead, and
+// writes on either side must stay private.
+void
+cowfork(char *s)
+{
+  uint64 sz = ((PHYSTOP - KERNBASE) / 3) * 2;
+  char *p, *q;
+  int ppid, pid, xstatus;
+
+  p = sbrk(sz);
+  if(p == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(%d) failed\n", s, (int)sz);
+    exit(1);
+  }
+  ppid = getpid();
+  for(q = p; q < p + sz; q += PGSIZE)
+    *(int*)q = ppid;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(q = p; q < p + sz; q += 64*PGSIZE){
+      if(*(int*)q != ppid)
+        exit(1);
+      *(int*)q = 0;
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong memory\n", s);
+    exit(1);
+  }
+  for(q = p; q < p + sz; q += PGSIZE){
+    if(*(int*)q != ppid){
+      printf("%s: child write visible in parent\n", s);
+      exit(1);
+    }
+  }
+  sbrk(-sz);
+}
+
+// sbrk() more than physical memory, touch a few scattered
+// pages, and check that they start out zero; lazy allocation
+// must only allocate what is touched.
+void
+lazysbrk(char *s)
+{
+  enum { HUGE=1024*1024*1024 };
+  char *a, *p;
+
+  a = sbrk(HUGE);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(HUGE) failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + HUGE; p += 4096*1024){
+    if(*p != 0){
+      printf("%s: lazy page not zero\n", s);
+      exit(1);
+    }
+    *p = 1;
+  }
+  for(p = a; p < a + HUGE; p += 4096*1024){
+    if(*p != 1){
+      printf("%s: lazy page lost write\n", s);
+      exit(1);
+    }
+  }
+  if(sbrk(-HUGE) == (char*)0xffffffffffffffffL || sbrk(0) != a){
+    printf("%s: could not shrink\n", s);
+    exit(1);
+  }
+}
+
 void
 sbrkbasic(char *s)
 {
@@ -2853,6 +3492,8 @@ main(int argc, char *argv[])
     {bigargtest, "bigargtest"},
     {bigwrite, "bigwrite"},
     {bsstest, "bsstest"},
+    {cowfork, "cowfork"},
+    {lazysbrk, "lazysbrk"},
     {sbrkbasic, "sbrkbasic"},
     {sbrkmuch, "sbrkmuch"},
     {kernmem, "kernmem"},
@@ -2881,6 +3522,14 @@ main(int argc, char *argv[])
     {iref, "iref"},
     {forktest, "forktest"},
     {bigdir, "bigdir"}, // slow
+    {dirindex, "dirindex"},
+    {dcache, "dcache"},
+    {getdentstest, "getdents"},
+    {prioritytest, "priority"},
+    {nanosleeptest, "nanosleep"},
+    {pipesizetest, "pipesize"},
+    {splicetest, "splice"},
+    {mmaptest, "mmap"},
     { 0, 0},
   };
 
@@ -5,54 +5,111 @@
 
 #define MAXBUF 1024
 
-int main(int argc, char *argv[]){
-    if(argc <= 1){
-        fprintf(2, "usage: xargs command args\n");
+// usage: xargs [-n num] [-P procs] command args
+// 每行输入是一个参数. 每次 exec 最多带 num 个参数 (默认 1 个),
+// 最多同时运行 procs 个子进程 (默认 1 个).
+
+char *cmd[MAXARG];   // command args, 后面接着输入的参数
+int ncmd;            // command args 的个数
+int maxper = 1;      // -n
+int maxprocs = 1;    // -P
+int running;         // 正在运行的子进程数
+
+char argbuf[MAXBUF]; // 这一批参数的字符串
+int nbuf, nargs;
+char buf[MAXBUF], line[MAXBUF]; // 用户栈只有一页, 不放在栈上
+
+void run() {
+    if (nargs == 0) return;
+
+    // 子进程太多就先等一个结束
+    if (running == maxprocs) {
+        wait(0);
+        --running;
+    }
+
+    cmd[ncmd + nargs] = 0; // exec 需要null终止的argv数组
+    int pid = fork();
+    if (pid == 0) {
+        exec(cmd[0], cmd);
+        fprintf(2, "xargs: exec %s failed\n", cmd[0]);
+        exit(1);
+    }
+    if (pid < 0) {
+        fprintf(2, "xargs: fork failed\n");
         exit(1);
     }
+    ++running;
 
-    char buf[MAXBUF];
-    char* args[MAXARG];
-    int n;
+    // 子进程已经有了自己的副本, 可以复用 argbuf
+    nbuf = nargs = 0;
+}
 
-    if((n = read(0, buf, MAXBUF)) < 0){
-        fprintf(2, "xargs: cannot read\n");
+// 把一行输入加入这一批参数, 满了就运行.
+void addarg(char *line, int len) {
+    if (len + 1 > MAXBUF) {
+        fprintf(2, "xargs: argument too long\n");
         exit(1);
     }
+    if (nbuf + len + 1 > MAXBUF) run();
 
-    int input_args = 0, arg_start = 0;
-    while(arg_start < n && buf[arg_start] == '\n'){
-        ++arg_start;
-    }
-    
+    memmove(argbuf + nbuf, line, len);
+    argbuf[nbuf + len] = 0;
+    cmd[ncmd + nargs++] = argbuf + nbuf;
+    nbuf += len + 1;
+
+    if (nargs == maxper) run();
+}
 
-    for(int i=arg_start+1; i<n; ++i){
-        if(buf[i] == '\n'){
-            buf[i] = 0;
-            args[input_args++] = &buf[arg_start];
-            arg_start = i+1;
+int main(int argc, char *argv[]){
+    int i;
+
+    for (i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            maxper = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-P") == 0) {
+            maxprocs = atoi(argv[i + 1]);
+        } else {
+            break;
         }
     }
-
-    if(arg_start < n){
-        args[input_args++] = &buf[arg_start];
+    ncmd = argc - i;
+    // 命令本身最多 MAXARG-2 个参数, 至少给输入留一个位置, 再加结尾的 0
+    if (ncmd <= 0 || ncmd >= MAXARG - 1 || maxper < 1 || maxprocs < 1) {
+        fprintf(2, "usage: xargs [-n num] [-P procs] command args\n");
+        exit(1);
+    }
+    for (int j = 0; j < ncmd; ++j) {
+        cmd[j] = argv[i + j];
+    }
+    // 还要留一个位置给 0
+    if (maxper > MAXARG - 1 - ncmd) {
+        maxper = MAXARG - 1 - ncmd;
     }
 
-    char* exec_argv[argc + 1];
-    exec_argv[argc] = 0; // exec 需要null终止的argv数组
+    // 边读边处理, 输入可以任意长. line 里是还没读完的一行
+    int n, len = 0;
 
-    for(int i=1; i<argc; ++i){
-        exec_argv[i-1] = argv[i];
+    while ((n = read(0, buf, sizeof(buf))) > 0) {
+        for (i = 0; i < n; ++i) {
+            if (buf[i] == '\n') {
+                if (len > 0) addarg(line, len);
+                len = 0;
+            } else if (len < MAXBUF) {
+                line[len++] = buf[i];
+            }
+        }
+    }
+    if (n < 0) {
+        fprintf(2, "xargs: cannot read\n");
+        exit(1);
     }
+    if (len > 0) addarg(line, len);
+    run();
 
-    for(int i=0; i<input_args; ++i){
-        if(fork() == 0){
-            exec_argv[argc - 1] = args[i];
-            exec(exec_argv[0], exec_argv);
-            fprintf(2, "exec %s failed\n", exec_argv[0]);
-        }
+    while (running > 0) {
         wait(0);
+        --running;
     }
-
     exit(0);
-}
\ No newline at end of file
+}